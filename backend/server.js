@@ -6,11 +6,13 @@ const jwt = require('jsonwebtoken');
 const bcrypt = require('bcryptjs');
 const path = require('path');
 const fs = require('fs');
+const crypto = require('crypto');
+const { Readable, pipeline } = require('stream');
 
 // Security middleware
 const securityHeaders = require('./middleware/security');
 const { apiLimiter, authLimiter, encryptionLimiter } = require('./middleware/rateLimiter');
-const { validateTextInput, validateFileInput, validateLoginInput } = require('./middleware/validation');
+const { validateTextInput, validateTextBatchInput, validateFileInput, validateLoginInput } = require('./middleware/validation');
 
 // Import the compiled C++ addon
 let lockstitch;
@@ -22,6 +24,7 @@ try {
   console.error('Error:', error.message);
   process.exit(1);
 }
+const { createEncryptStream, createDecryptStream } = require('./cipherStream')(lockstitch);
 
 const app = express();
 const PORT = process.env.PORT || 3001;
@@ -68,6 +71,69 @@ const storage = multer.diskStorage({
 
 const upload = multer({ storage });
 
+// Uploads up to this size stay in memory and go through the native buffer API without touching disk
+const MEMORY_UPLOAD_LIMIT = parseInt(process.env.MEMORY_UPLOAD_LIMIT) || 32 * 1024 * 1024;
+const memoryUpload = multer({ storage: multer.memoryStorage() });
+
+// Failures the client caused (a wrong password, data that is not .claudo, an oversized or malformed
+// upload) are routine: they answer 4xx and are logged only when LOCKSTITCH_LOG_LEVEL=debug, the same
+// variable the addon reads for its own debug log. Anything else is a server-side fault and is always logged.
+const DEBUG_LOG = (process.env.LOCKSTITCH_LOG_LEVEL || '').toLowerCase() === 'debug';
+const CLIENT_ERRORS = new Map([
+  ['Password incorrect', 401],
+  ['Decrypting failed. Is the file actually encrypted?', 400],
+]);
+// Oversized stream input rejects with a RangeError
+const failureStatus = (error) => (error instanceof RangeError ? 413 : CLIENT_ERRORS.get(error.message) || 500);
+const isClientError = (error) => failureStatus(error) !== 500;
+const logFailure = (label, error, clientFault = isClientError(error)) => {
+  if (!clientFault) {
+    console.error(label, error);
+  } else if (DEBUG_LOG) {
+    console.debug(label, error.message);
+  }
+};
+
+const uploadFile = (req, res, next) => {
+  const length = parseInt(req.headers['content-length']);
+  const uploader = length > 0 && length <= MEMORY_UPLOAD_LIMIT ? memoryUpload : upload;
+  uploader.single('file')(req, res, (error) => {
+    if (!error) {
+      return next();
+    }
+    // Errors from the filesystem are the server's; the rest come from parsing the request
+    const clientFault = !error.syscall;
+    logFailure('Upload error:', error, clientFault);
+    res.status(clientFault ? 400 : 500).json({ error: 'Upload failed: ' + error.message });
+  });
+};
+
+const mimeTypeFor = (ext) => {
+  if (ext === 'mp4') return 'video/mp4';
+  if (ext === 'mov') return 'video/quicktime';
+  if (ext === 'avi') return 'video/x-msvideo';
+  if (ext === 'webm') return 'video/webm';
+  if (ext === 'pdf') return 'application/pdf';
+  if (ext === 'jpg' || ext === 'jpeg') return 'image/jpeg';
+  if (ext === 'png') return 'image/png';
+  if (ext === 'gif') return 'image/gif';
+  return 'application/octet-stream';
+};
+
+// Pipes the raw request body through a cipher stream into the response
+const pipeCipher = (req, res, cipher, action) => {
+  cipher.on('error', (error) => {
+    logFailure(`Stream ${action} error:`, error);
+    if (!res.headersSent) {
+      res.status(failureStatus(error)).json({ error: error.message });
+    } else {
+      res.destroy(error);
+    }
+  });
+  req.on('error', (error) => cipher.destroy(error));
+  req.pipe(cipher).pipe(res);
+};
+
 // Auth middleware
 const authenticateToken = (req, res, next) => {
   const authHeader = req.headers['authorization'];
@@ -93,19 +159,22 @@ app.get('/api/health', (req, res) => {
   res.json({ status: 'ok', message: 'Backend server running' });
 });
 
+// Native per-phase timings (load, mul/div, hex, XOR, write); ?reset=1 clears them after reading
+app.get('/api/metrics', authenticateToken, (req, res) => {
+  res.json({ uptime: process.uptime(), ...lockstitch.stats(req.query.reset === '1') });
+});
+
 // Login
 app.post('/api/auth/login', (req, res) => {
   const { password } = req.body;
-  // DEBUG: Log received password and APP_PASSWORD
-  console.log('LOGIN DEBUG: received password:', password);
-  console.log('LOGIN DEBUG: APP_PASSWORD from env:', APP_PASSWORD);
 
   if (!password) {
     return res.status(400).json({ error: 'Password required' });
   }
 
   if (password === APP_PASSWORD) {
-    const token = jwt.sign({ authenticated: true }, JWT_SECRET, { expiresIn: '24h' });
+    // sid identifies the session, and owns the media it stores
+    const token = jwt.sign({ authenticated: true, sid: crypto.randomBytes(16).toString('hex') }, JWT_SECRET, { expiresIn: '24h' });
     res.json({ token, message: 'Login successful' });
   } else {
     res.status(401).json({ error: 'Invalid password' });
@@ -113,7 +182,7 @@ app.post('/api/auth/login', (req, res) => {
 });
 
 // Text Encryption
-app.post('/api/encrypt/text', authenticateToken, encryptionLimiter, validateTextInput, (req, res) => {
+app.post('/api/encrypt/text', authenticateToken, encryptionLimiter, validateTextInput, async (req, res) => {
   try {
     const { text, password } = req.body;
 
@@ -125,7 +194,7 @@ app.post('/api/encrypt/text', authenticateToken, encryptionLimiter, validateText
       return res.status(400).json({ error: 'Password required' });
     }
 
-    const encrypted = lockstitch.encryptString(text, password);
+    const encrypted = await lockstitch.encryptStringAsync(text, password);
     res.json({ encryptedText: encrypted });
   } catch (error) {
     console.error('Encryption error:', error);
@@ -134,7 +203,7 @@ app.post('/api/encrypt/text', authenticateToken, encryptionLimiter, validateText
 });
 
 // Text Decryption
-app.post('/api/decrypt/text', authenticateToken, encryptionLimiter, validateTextInput, (req, res) => {
+app.post('/api/decrypt/text', authenticateToken, encryptionLimiter, validateTextInput, async (req, res) => {
   try {
     const { encryptedText, password } = req.body;
 
@@ -146,16 +215,51 @@ app.post('/api/decrypt/text', authenticateToken, encryptionLimiter, validateText
       return res.status(400).json({ error: 'Password required' });
     }
 
-    const decrypted = lockstitch.decryptString(encryptedText, password);
+    const decrypted = await lockstitch.decryptStringAsync(encryptedText, password);
     res.json({ decryptedText: decrypted });
   } catch (error) {
-    console.error('Decryption error:', error);
-    res.status(500).json({ error: 'Decryption failed: ' + error.message });
+    logFailure('Decryption error:', error);
+    res.status(failureStatus(error)).json({ error: 'Decryption failed: ' + error.message });
+  }
+});
+
+// Batch Text Encryption: { texts: [...] } -> { encryptedTexts: [...] } in one native call.
+// Text encryption uses the built-in text key, so the batch routes take no password.
+app.post('/api/encrypt/texts', authenticateToken, encryptionLimiter, validateTextBatchInput, async (req, res) => {
+  try {
+    const { texts } = req.body;
+
+    if (!texts) {
+      return res.status(400).json({ error: 'Texts required' });
+    }
+
+    const encryptedTexts = await lockstitch.encryptStringsAsync(texts);
+    res.json({ encryptedTexts });
+  } catch (error) {
+    console.error('Batch encryption error:', error);
+    res.status(500).json({ error: 'Encryption failed: ' + error.message });
+  }
+});
+
+// Batch Text Decryption: { encryptedTexts: [...] } -> { decryptedTexts: [...] }
+app.post('/api/decrypt/texts', authenticateToken, encryptionLimiter, validateTextBatchInput, async (req, res) => {
+  try {
+    const { encryptedTexts } = req.body;
+
+    if (!encryptedTexts) {
+      return res.status(400).json({ error: 'Encrypted texts required' });
+    }
+
+    const decryptedTexts = await lockstitch.decryptStringsAsync(encryptedTexts);
+    res.json({ decryptedTexts });
+  } catch (error) {
+    logFailure('Batch decryption error:', error);
+    res.status(failureStatus(error)).json({ error: 'Decryption failed: ' + error.message });
   }
 });
 
 // File Encryption
-app.post('/api/encrypt/file', authenticateToken, encryptionLimiter, upload.single('file'), validateFileInput, (req, res) => {
+app.post('/api/encrypt/file', authenticateToken, encryptionLimiter, uploadFile, validateFileInput, async (req, res) => {
   try {
     if (!req.file) {
       return res.status(400).json({ error: 'File required' });
@@ -173,27 +277,42 @@ app.post('/api/encrypt/file', authenticateToken, encryptionLimiter, upload.singl
     console.log('Encryption request:');
     console.log('  File:', req.file.originalname);
     console.log('  Size:', req.file.size, 'bytes');
-    console.log('  Password:', password);
     console.log('  Head size:', headSizeInt);
 
-    // Call C++ encryption
-    const result = lockstitch.encryptFile(filePath, password, headSizeInt);
-    console.log('Encryption result:', result);
+    // Generate output filename (keep original name, add .claudo extension)
+    const originalName = req.file.originalname;
+    const outputFilename = `${originalName.replace(/\.[^.]+$/, '')}.claudo`;
+
+    // In-memory upload: encrypt the buffer and send the result directly
+    if (req.file.buffer) {
+      let encrypted;
+      try {
+        const extension = path.extname(originalName).substring(1);
+        encrypted = await lockstitch.encryptBufferAsync(req.file.buffer, extension, password, headSizeInt);
+      } catch (cryptoError) {
+        return res.status(500).json({ error: cryptoError.message });
+      }
+
+      console.log('Sending encrypted file:', outputFilename);
+      res.setHeader('Content-Type', 'application/octet-stream');
+      res.setHeader('Content-Disposition', `attachment; filename="${outputFilename}"`);
+      return res.send(encrypted);
+    }
 
-    // Check if encryption was successful
-    if (result.includes('Error') || result.includes('error')) {
+    // Call C++ encryption on the libuv thread pool; failures reject
+    let result;
+    try {
+      result = await lockstitch.encryptFileAsync(filePath, password, headSizeInt);
+    } catch (cryptoError) {
       // Clean up uploaded file
       fs.unlinkSync(filePath);
-      return res.status(500).json({ error: result });
+      return res.status(500).json({ error: cryptoError.message });
     }
+    console.log('Encryption result:', result);
 
     // The result is the path to the encrypted file
     const encryptedFilePath = result;
 
-    // Generate output filename (keep original name, add .claudo extension)
-    const originalName = req.file.originalname;
-    const outputFilename = `${originalName.replace(/\.[^.]+$/, '')}.claudo`;
-    
     console.log('Sending encrypted file:', outputFilename);
 
     // Set headers explicitly
@@ -237,7 +356,7 @@ app.post('/api/encrypt/file', authenticateToken, encryptionLimiter, upload.singl
 });
 
 // File Decryption
-app.post('/api/decrypt/file', authenticateToken, encryptionLimiter, upload.single('file'), validateFileInput, (req, res) => {
+app.post('/api/decrypt/file', authenticateToken, encryptionLimiter, uploadFile, validateFileInput, async (req, res) => {
   try {
     if (!req.file) {
       return res.status(400).json({ error: 'File required' });
@@ -255,19 +374,50 @@ app.post('/api/decrypt/file', authenticateToken, encryptionLimiter, upload.singl
     console.log('  File:', req.file.originalname);
     console.log('  Size:', req.file.size, 'bytes');
     console.log('  Password length:', password.length);
-    console.log('  Password:', password); // DEBUG: Show actual password
 
-    // Call C++ decryption
-    const result = lockstitch.decryptFile(filePath, password);
-    
-    console.log('Decryption result:', result);
+    // In-memory upload: decrypt the buffer and send the result directly
+    if (req.file.buffer) {
+      let decrypted;
+      try {
+        decrypted = await lockstitch.decryptBufferAsync(req.file.buffer, password);
+      } catch (cryptoError) {
+        logFailure('File decryption error:', cryptoError);
+        return res.status(failureStatus(cryptoError)).json({ error: cryptoError.message });
+      }
+
+      const baseNameWithoutClaudo = req.file.originalname.replace(/\.claudo$/i, '');
+      const decryptedExt = decrypted.extension ? `.${decrypted.extension}` : '';
+      const outputFilename = `${baseNameWithoutClaudo}_decrypted${decryptedExt}`;
+      const mimeType = mimeTypeFor(decrypted.extension.toLowerCase());
+
+      console.log('Sending decrypted file:', outputFilename, 'MIME:', mimeType);
+      res.setHeader('Content-Type', mimeType);
+      res.setHeader('Content-Disposition', `attachment; filename="${outputFilename}"`);
+      return res.send(decrypted.data);
+    }
 
-    // Check if decryption was successful
-    if (result.includes('Error') || result.includes('error') || result.includes('failed') || result.includes('Failed')) {
+    // A wrong password or a file that is not .claudo is caught from the last bytes of the upload,
+    // without waiting behind other file jobs
+    try {
+      await lockstitch.inspectFileAsync(filePath, password);
+    } catch (cryptoError) {
+      logFailure('File decryption error:', cryptoError);
+      fs.unlinkSync(filePath);
+      return res.status(failureStatus(cryptoError)).json({ error: cryptoError.message });
+    }
+
+    // Call C++ decryption on the libuv thread pool; wrong password or bad input rejects
+    let result;
+    try {
+      result = await lockstitch.decryptFileAsync(filePath, password);
+    } catch (cryptoError) {
+      logFailure('File decryption error:', cryptoError);
       // Clean up uploaded file
       fs.unlinkSync(filePath);
-      return res.status(500).json({ error: result });
+      return res.status(failureStatus(cryptoError)).json({ error: cryptoError.message });
     }
+    
+    console.log('Decryption result:', result);
 
     // The result is the path to the decrypted file
     const decryptedFilePath = result;
@@ -291,15 +441,7 @@ app.post('/api/decrypt/file', authenticateToken, encryptionLimiter, upload.singl
     
     // Determine MIME type from file extension
     const ext = decryptedExt.substring(1).toLowerCase(); // Remove leading dot
-    let mimeType = 'application/octet-stream';
-    if (ext === 'mp4') mimeType = 'video/mp4';
-    else if (ext === 'mov') mimeType = 'video/quicktime';
-    else if (ext === 'avi') mimeType = 'video/x-msvideo';
-    else if (ext === 'webm') mimeType = 'video/webm';
-    else if (ext === 'pdf') mimeType = 'application/pdf';
-    else if (ext === 'jpg' || ext === 'jpeg') mimeType = 'image/jpeg';
-    else if (ext === 'png') mimeType = 'image/png';
-    else if (ext === 'gif') mimeType = 'image/gif';
+    const mimeType = mimeTypeFor(ext);
     
     console.log('Sending decrypted file:', outputFilename, 'MIME:', mimeType);
 
@@ -343,6 +485,167 @@ app.post('/api/decrypt/file', authenticateToken, encryptionLimiter, upload.singl
   }
 });
 
+// Streaming File Encryption: raw body in (password in X-Password, name in ?filename=), .claudo out,
+// without multer or any file on disk
+app.post('/api/encrypt/stream', authenticateToken, encryptionLimiter, (req, res) => {
+  const password = req.get('X-Password');
+  const fileName = path.basename(req.query.filename || 'file');
+  const headSizeInt = parseInt(req.query.headSize) || 0;
+
+  if (!password || password.length > 128) {
+    return res.status(400).json({ error: 'Invalid password' });
+  }
+
+  if (headSizeInt < 0 || headSizeInt > 1000000) {
+    return res.status(400).json({ error: 'Invalid header size value' });
+  }
+
+  const extension = path.extname(fileName).substring(1);
+  const cipher = createEncryptStream({ extension, password, headSize: headSizeInt });
+  const outputFilename = `${fileName.replace(/\.[^.]+$/, '')}.claudo`;
+
+  res.setHeader('Content-Type', 'application/octet-stream');
+  res.setHeader('Content-Disposition', `attachment; filename="${outputFilename}"`);
+  pipeCipher(req, res, cipher, 'encryption');
+});
+
+// Buffered File Decryption: raw body in, plaintext out. Not streaming: the key position and password
+// are stored at the end, so the body is held in memory (up to MEMORY_UPLOAD_LIMIT) until it is complete.
+app.post('/api/decrypt/stream', authenticateToken, encryptionLimiter, (req, res) => {
+  const password = req.get('X-Password');
+  const fileName = path.basename(req.query.filename || 'file.claudo');
+
+  if (!password || password.length > 128) {
+    return res.status(400).json({ error: 'Invalid password' });
+  }
+
+  const length = parseInt(req.headers['content-length']);
+  if (length > MEMORY_UPLOAD_LIMIT) {
+    return res.status(413).json({ error: `Encrypted body is larger than ${MEMORY_UPLOAD_LIMIT} bytes` });
+  }
+
+  const cipher = createDecryptStream({ password, maxInput: MEMORY_UPLOAD_LIMIT });
+  cipher.on('extension', (extension) => {
+    const baseNameWithoutClaudo = fileName.replace(/\.claudo$/i, '');
+    const decryptedExt = extension ? `.${extension}` : '';
+    res.setHeader('Content-Type', mimeTypeFor(extension.toLowerCase()));
+    res.setHeader('Content-Disposition', `attachment; filename="${baseNameWithoutClaudo}_decrypted${decryptedExt}"`);
+  });
+  pipeCipher(req, res, cipher, 'decryption');
+});
+
+// Encrypted media kept on the server for playback. Reads go through a RangeReader, so a seek
+// decrypts only the bytes asked for and no plaintext file is ever written.
+// Media lives in media/<sid>/<id>, apart from the temporary uploads in uploads/. The sid comes from the
+// signed login token and the id is random, so a session can only reach the media it stored itself.
+const MEDIA_CHUNK = 4 * 1024 * 1024;
+const MEDIA_DIR = path.join(__dirname, 'media');
+const MEDIA_ID = /^[0-9a-f]{32}$/;
+const mediaPath = (req) => (MEDIA_ID.test(req.params.id) ? path.join(MEDIA_DIR, req.user.sid, req.params.id) : null);
+
+// Tokens issued before sessions had an id cannot own media
+const requireSession = (req, res, next) => {
+  if (!req.user || typeof req.user.sid !== 'string' || !MEDIA_ID.test(req.user.sid)) {
+    return res.status(403).json({ error: 'Session cannot store media; log in again' });
+  }
+  next();
+};
+
+const mediaUpload = multer({
+  storage: multer.diskStorage({
+    destination: (req, file, cb) => {
+      const dir = path.join(MEDIA_DIR, req.user.sid);
+      fs.mkdir(dir, { recursive: true }, (error) => cb(error, dir));
+    },
+    filename: (req, file, cb) => cb(null, crypto.randomBytes(16).toString('hex'))
+  })
+});
+
+// Store a .claudo file; the returned id names it in /api/media/:id for this session
+app.post('/api/media', authenticateToken, requireSession, encryptionLimiter, mediaUpload.single('file'), (req, res) => {
+  if (!req.file) {
+    return res.status(400).json({ error: 'File required' });
+  }
+  res.json({ id: req.file.filename, size: req.file.size });
+});
+
+// Plaintext of stored media (password in X-Password), honouring a single "bytes=start-end" Range
+app.get('/api/media/:id', authenticateToken, requireSession, async (req, res) => {
+  const password = req.get('X-Password');
+  const filePath = mediaPath(req);
+
+  if (!password || password.length > 128) {
+    return res.status(400).json({ error: 'Invalid password' });
+  }
+  if (!filePath || !fs.existsSync(filePath)) {
+    return res.status(404).json({ error: 'Media not found' });
+  }
+
+  // The password and layout are checked from the end of the file before the prefix is divided.
+  // The reader then divides it once for the whole response; its empty first read gives the plaintext size.
+  const reader = new lockstitch.RangeReader(filePath, password);
+  let info;
+  try {
+    await lockstitch.inspectFileAsync(filePath, password);
+    info = await reader.read(0, 0);
+  } catch (cryptoError) {
+    logFailure('Media error:', cryptoError);
+    return res.status(failureStatus(cryptoError)).json({ error: cryptoError.message });
+  }
+
+  const total = info.totalSize;
+  let start = 0;
+  let end = total - 1;
+  const range = /^bytes=(\d*)-(\d*)$/.exec(req.headers.range || '');
+  if (range && (range[1] || range[2])) {
+    if (range[1]) {
+      start = parseInt(range[1]);
+      end = range[2] ? Math.min(end, parseInt(range[2])) : end;
+    } else {
+      start = Math.max(0, total - parseInt(range[2]));
+    }
+    if (start >= total || start > end) {
+      res.setHeader('Content-Range', `bytes */${total}`);
+      return res.status(416).end();
+    }
+    res.status(206);
+    res.setHeader('Content-Range', `bytes ${start}-${end}/${total}`);
+  }
+
+  res.setHeader('Accept-Ranges', 'bytes');
+  res.setHeader('Content-Type', mimeTypeFor(info.extension.toLowerCase()));
+  res.setHeader('Content-Length', end - start + 1);
+  if (req.method === 'HEAD') {
+    return res.end();
+  }
+
+  // Decrypted a chunk at a time, so a full-length request never holds the whole file
+  async function* chunks() {
+    for (let pos = start; pos <= end; pos += MEDIA_CHUNK) {
+      const part = await reader.read(pos, Math.min(MEDIA_CHUNK, end - pos + 1));
+      yield part.data;
+    }
+  }
+  pipeline(Readable.from(chunks()), res, (error) => {
+    if (error && error.code !== 'ERR_STREAM_PREMATURE_CLOSE') {
+      console.error('Media range error:', error);
+    }
+  });
+});
+
+app.delete('/api/media/:id', authenticateToken, requireSession, (req, res) => {
+  const filePath = mediaPath(req);
+  if (!filePath) {
+    return res.status(404).json({ error: 'Media not found' });
+  }
+  fs.unlink(filePath, (error) => {
+    if (error) {
+      return res.status(404).json({ error: 'Media not found' });
+    }
+    res.json({ deleted: true });
+  });
+});
+
 // Start server
 app.listen(PORT, () => {
   console.log('');
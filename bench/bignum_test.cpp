@@ -0,0 +1,386 @@
+// bignum_test.cpp
+// The limb multiply and divide against the bit-serial code they replaced, whose output is the on-disk format.
+// mulString/divString are compared with a copy of the bit-serial versions at the three key positions of
+// primitives_bench, for keys of 1-4 limbs and operands either side of each limb edge. Text and file
+// ciphertexts are compared with known answers produced by the bit-serial build at fixed key positions.
+//
+// usage: bignum_test
+// Prints the first few mismatches and exits non-zero if there are any.
+
+#include "Lockstitch.h"
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Key positions: the full 1000-byte key, a mid-table one and the shortest one encrypt can pick
+#define KEY_FULL 1
+#define KEY_MID 1500
+#define KEY_SHORT 2037
+
+// Reaches the private primitives; declared a friend in Lockstitch.h
+class LockstitchTest
+{
+public:
+    static Lockstitch& lock() { return Lockstitch::getLockstitch(); }
+    static size_t tableSize() { return lock().m_constantString.length(); }
+    static shared_ptr<const KeySlice> key(int number, size_t maxLen) { return lock().getKeySlice(number, maxLen); }
+
+    static vector<unsigned char> mulString(vector<unsigned char> v, const KeySlice& key) { return lock().mulString(v, key); }
+    static vector<unsigned char> divString(vector<unsigned char> hex, const KeySlice& key) { return lock().divString(hex, key); }
+    static vector<unsigned char> toHex(vector<unsigned char> v) { return lock().charListToHexCharArray(v); }
+    static string encryptAt(const string& content, int number) { return lock().encryptAt(content, number); }
+    static string decrypt(string content) { return lock().decrypt(content); }
+
+    // Payload and start location, as encryptFile writes them ahead of the trailer
+    static vector<unsigned char> encryptData(const vector<unsigned char>& in, const string& ext, int headSize, int number)
+    {
+        SegmentList segments;
+        string startLocation = lock().encryptData(in.data(), in.size(), segments, ext, headSize, number);
+        vector<unsigned char> out(segments.total);
+        lock().gatherSegments(segments, out.data());
+        out.insert(out.end(), startLocation.begin(), startLocation.end());
+        return out;
+    }
+
+    static bool decryptData(const vector<unsigned char>& in, vector<unsigned char>& out, const string& ext)
+    {
+        SegmentList segments;
+        if (lock().decryptData(in.data(), in.size(), segments, ext) != 0)
+            return false;
+        out.resize(segments.total);
+        lock().gatherSegments(segments, out.data());
+        return true;
+    }
+};
+
+// mulString and divString as they were before the limb arithmetic, one bit per byte
+static vector<unsigned char> refMul(const vector<unsigned char>& str1, const string& str2)
+{
+    vector<unsigned char> destStr;
+    int n1 = str1.size() * 8;
+    int n2 = str2.length() * 8;
+    int n = n1 + n2;
+    if (n == 0)
+        return destStr;
+
+    vector<unsigned char> V1(n1), V2(n2), V(n, 0);
+    for (int j = 0, i = str1.size() - 1; i >= 0; i--)
+        for (int k = 0, c = str1[i]; k < 8; k++)
+            V1[j++] = (c >> k) & 1;
+    for (int j = 0, i = str2.length() - 1; i >= 0; i--)
+        for (int k = 0, c = str2[i]; k < 8; k++)
+            V2[j++] = (c >> k) & 1;
+
+    for (int i = 0; i < n2; i++)
+    {
+        int overflow = 0;
+        if (V2[i] == 1)
+        {
+            for (int j = 0; j < n1; j++)
+            {
+                int temp = V1[j] + V[i + j] + overflow;
+                V[i + j] = temp & 1;
+                overflow = temp >> 1;
+            }
+            if (overflow == 1)
+                V[i + n1] = 1;
+        }
+    }
+
+    for (int c = 0, j = 0, i = n - 1; i >= 0; i--)
+    {
+        c = (c << 1) | V[i];
+        if (++j == 8)
+        {
+            destStr.push_back(c);
+            c = 0;
+            j = 0;
+        }
+    }
+
+    return destStr;
+}
+
+static vector<unsigned char> refDiv(const vector<unsigned char>& str1, const string& str2)
+{
+    vector<unsigned char> output;
+    int n1 = str1.size() * 4;
+    int n2 = str2.length() * 8;
+    if (n1 == 0 || n2 == 0 || n1 < n2)
+        return output;
+
+    vector<unsigned char> V1(n1), V2(n2);
+    for (int i = 0, j = n1 - 1; i < (int)str1.size(); i++)
+    {
+        int c = 0;
+        if (str1[i] >= '0' && str1[i] <= '9')
+            c = str1[i] - '0';
+        else if (str1[i] >= 'a' && str1[i] <= 'f')
+            c = str1[i] - 'a' + 10;
+        for (int k = 3; k >= 0; k--)
+            V1[j--] = (c >> k) & 1;
+    }
+    for (int j = 0, i = str2.length() - 1; i >= 0; i--)
+        for (int k = 0, c = str2[i]; k < 8; k++)
+            V2[j++] = (c >> k) & 1;
+
+    while (n1 > 0 && V1[n1 - 1] == 0)
+        n1--;
+    while (n2 > 0 && V2[n2 - 1] == 0)
+        n2--;
+    if (n1 == 0 || n2 == 0 || n1 < n2)
+        return output;
+
+    // The original sized the quotient from the untrimmed widths and wrote past it for wide quotients
+    int n = n1 - n2 + 1;
+    vector<unsigned char> V(n, 0);
+    for (int i = n1 - n2; i >= 0; i--)
+    {
+        bool bLarge = true;
+        if (n1 - i < n2)
+            bLarge = false;
+        else if (n1 - i == n2)
+        {
+            for (int j = n2 - 1; j >= 0; j--)
+            {
+                if (V1[i + j] != V2[j])
+                {
+                    bLarge = V1[i + j] > V2[j];
+                    break;
+                }
+            }
+        }
+        if (!bLarge)
+            continue;
+
+        V[i] = 1;
+        int overflow = 0;
+        for (int j = 0; j < n2; j++)
+        {
+            int temp = (i + j < n1 && V1[i + j]) - V2[j] - overflow;
+            overflow = temp < 0;
+            V1[i + j] = temp & 1;
+        }
+        if (overflow == 1)
+            V1[n1 - 1] = 0;
+        while (n1 > 0 && V1[n1 - 1] == 0)
+            n1--;
+    }
+
+    if (V[n - 1] == 0)
+        n--;
+    int N = (n + 7) / 8;
+    output.resize(N);
+    for (int i = 0; i < n; i++)
+        output[N - 1 - i / 8] |= V[i] << (i % 8);
+
+    return output;
+}
+
+struct TextAnswer
+{
+    int number;
+    const char* plain;
+    const char* cipher;
+};
+
+// Ciphertexts of the bit-serial build
+static const TextAnswer textAnswers[] = {
+    { 1, "A", "p]EX18fb714cba3cbef44489e2" },
+    { 1, "Hello, world", "p]EX1bd329f0017a532f80c1dfa440084b96b1b91e6ca248" },
+    { 1, "Lockstit", "p]EX1d608f35ac3f82ebed9b3ad6ba7ac41f9268" },
+    { 1, "sixteen bytes!!!", "p]EX2c5b8cecf08638c1549c972c3e41689b5ee951393156cf3dffa2" },
+    { 1, "seventeen bytes!!", "p]EX2c5a029196341d0b9fd6effbc5b66a41688eaffe90ab6144a1ffa2" },
+    { 1, "The quick brown fox jumps over it", "p]EX207100c33cf9fa8ba1d3e177fb1a2b35b89e7f015398b0ce18efda2800fa89b9eff5022684158d2df79268" },
+    { 1, "caf\xc3\xa9 \xe2\x9c\x93", "p]EX26322fb8a28a5df00df2a8f08b60fdc8e01346" },
+    { 1500, "A", "qXEY18bab1caf04645c3008171" },
+    { 1500, "Hello, world", "qXEY1b8b0c5872ce592a8dbd615e8d57827ddd77b5437324" },
+    { 1500, "Lockstit", "qXEY1d146ba904fbdadd87bae89a4647ad393334" },
+    { 1500, "sixteen bytes!!!", "qXEY2be895f78196b1f67d7832a1b435a269cae223f7ac0f74c62c51" },
+    { 1500, "seventeen bytes!!", "qXEY2be70f9a3c2d5945069f0b81f0c9ca35a25d3cd6a54e6cd0782c51" },
+    { 1500, "The quick brown fox jumps over it", "qXEY201cec1df70aaba9bced8f1cc782c6bd37aa9b02c5c270618ca5ff4f76d78cbe27ffdb59b1ae1f08253334" },
+    { 1500, "caf\xc3\xa9 \xe2\x9c\x93", "qXEY25cf30ecd575de999ad972fce7398269136723" },
+    { 2037, "A", "r]F^18efcffeba7cae4cf00538" },
+    { 2037, "Hello, world", "r]F^1bc635da5572bcb7177db84374845392ccc7c49931e0" },
+    { 2037, "Lockstit", "r]F^1d52e21f90a6ef525fbaee90f23f3286fd60" },
+    { 2037, "sixteen bytes!!!", "r]F^2c46e683e59441b04549993d3f0cf4b7978110cb80d7afff5638" },
+    { 2037, "seventeen bytes!!", "r]F^2c455ce0218b951dcf6abf728e350f0cf4aaee7dde3d904fef5638" },
+    { 2037, "The quick brown fox jumps over it", "r]F^2061e67d7538f3f0a3c8968e35a5f3fe753d208b690cfa8557ed1b759f3c0a395bafa80d433c7ddc26fd60" },
+    { 2037, "caf\xc3\xa9 \xe2\x9c\x93", "r]F^262067a131d5f19834d9ef84aa8150ad7bd528" },
+};
+
+struct FileAnswer
+{
+    int number;
+    const char* ext;
+    size_t size;
+    int headSize;
+    // FNV-1a of the payload and start location
+    uint64_t hash;
+};
+
+static const FileAnswer fileAnswers[] = {
+    { 1, "pdf", 1, 0, 0x0c232dcd539aaee0ull },
+    { 1, "pdf", 8, 0, 0x03b448f0ff2e351bull },
+    { 1, "pdf", 9, 0, 0xb462ce2c9ec5f7deull },
+    { 1, "pdf", 33, 0, 0x9a77fb67870f61adull },
+    { 1, "pdf", 40000, 0, 0x4796f50ce7aa56a7ull },
+    { 1, "pdf", 40001, 0, 0x077953a91051b0d2ull },
+    { 1, "pdf", 100000, 0, 0x1c7b7ff06318865full },
+    { 1, "pdf", 100000, 5, 0x3bed2d1ee5155616ull },
+    { 1, "mp4", 33, 0, 0xf486f881210a6891ull },
+    { 1, "mp4", 100000, 0, 0x71766e6d2eb3cae9ull },
+    { 1, "mp4", 100000, 5, 0x9521ed340ba8b440ull },
+    { 1500, "pdf", 1, 0, 0x8d8d761d4f2ab5cdull },
+    { 1500, "pdf", 8, 0, 0x4e175133f68ac2feull },
+    { 1500, "pdf", 9, 0, 0x0a8cdb4f24afc65bull },
+    { 1500, "pdf", 33, 0, 0x2d7aee42801eddf8ull },
+    { 1500, "pdf", 40000, 0, 0xc3b8dcb9cac78454ull },
+    { 1500, "pdf", 40001, 0, 0xe52b4281b01a864dull },
+    { 1500, "pdf", 100000, 0, 0xd0c947ce644f3fa3ull },
+    { 1500, "pdf", 100000, 5, 0x23041714b4653ecaull },
+    { 1500, "mp4", 33, 0, 0x4eb382d9ba91dad8ull },
+    { 1500, "mp4", 100000, 0, 0xf3f07311bfda04a5ull },
+    { 1500, "mp4", 100000, 5, 0xe9651c8bdc0bb800ull },
+    { 2037, "pdf", 1, 0, 0x76a8d73def1c2c16ull },
+    { 2037, "pdf", 8, 0, 0x1355514982fff623ull },
+    { 2037, "pdf", 9, 0, 0xfab475f41c12cd14ull },
+    { 2037, "pdf", 33, 0, 0x659591db2e19b210ull },
+    { 2037, "pdf", 40000, 0, 0xc4036067777276f8ull },
+    { 2037, "pdf", 40001, 0, 0xccf411b3e0e7dc43ull },
+    { 2037, "pdf", 100000, 0, 0xd35fcc911ce63422ull },
+    { 2037, "pdf", 100000, 5, 0x2c9bfcba3849630full },
+    { 2037, "mp4", 33, 0, 0xb6c4687fb2cdfbaeull },
+    { 2037, "mp4", 100000, 0, 0x4d4977725502d0adull },
+    { 2037, "mp4", 100000, 5, 0xf3a1d38b3d585df0ull },
+};
+
+static int failures = 0;
+
+static void fail(const string& what)
+{
+    if (++failures <= 10)
+        fprintf(stderr, "FAIL %s\n", what.c_str());
+}
+
+static vector<unsigned char> pattern(size_t n)
+{
+    vector<unsigned char> v(n);
+    unsigned int seed = (unsigned int)n + 1;
+    for (unsigned char& c : v)
+        c = (unsigned char)((seed = seed * 1103515245 + 12345) >> 16);
+    // A leading zero byte does not survive the multiply/divide prefix
+    if (n)
+        v[0] |= 1;
+
+    return v;
+}
+
+static uint64_t fnv1a(const vector<unsigned char>& v)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : v)
+        h = (h ^ c) * 1099511628211ull;
+
+    return h;
+}
+
+// One operand against one key: the product, its exact quotient and the quotient of a random dividend
+static void checkOperand(const vector<unsigned char>& v, const KeySlice& key, mt19937& rng, const string& label)
+{
+    vector<unsigned char> product = LockstitchTest::mulString(v, key);
+    if (product != refMul(v, key.key))
+        fail("mulString " + label);
+
+    vector<unsigned char> hex = LockstitchTest::toHex(product);
+    vector<unsigned char> quotient = LockstitchTest::divString(hex, key);
+    if (quotient != refDiv(hex, key.key) || (v[0] != 0 && quotient != v))
+        fail("divString " + label);
+
+    static const char digits[] = "0123456789abcdef";
+    vector<unsigned char> dividend(1 + rng() % (2 * (v.size() + key.key.length())));
+    for (unsigned char& c : dividend)
+        c = digits[rng() % 16];
+    if (LockstitchTest::divString(dividend, key) != refDiv(dividend, key.key))
+        fail("divString of a random dividend " + label);
+}
+
+static void checkArithmetic()
+{
+    // Keys of 1-4 limbs come from the end of the table, the rest from the usual positions
+    vector<pair<int, size_t>> keys;
+    for (int number : { KEY_FULL, KEY_MID, KEY_SHORT })
+    {
+        keys.push_back({ number, TEXT_KEY_SIZE });
+        keys.push_back({ number, FILE_KEY_SIZE });
+    }
+    for (size_t bytes : { 1, 2, 7, 8, 9, 15, 16, 17, 24, 25, 31, 32, 33 })
+        keys.push_back({ (int)(LockstitchTest::tableSize() - bytes), FILE_KEY_SIZE });
+
+    mt19937 rng(2024);
+    for (const pair<int, size_t>& k : keys)
+    {
+        shared_ptr<const KeySlice> key = LockstitchTest::key(k.first, k.second);
+        for (size_t size : { 1, 2, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33, 40, 64, 65, 200, 1000 })
+        {
+            string label = "at " + to_string(k.first) + " (" + to_string(key->key.length()) + "-byte key), " + to_string(size) + " bytes";
+            vector<unsigned char> v(size);
+            for (int round = 0; round < 4; ++round)
+            {
+                for (unsigned char& c : v)
+                    c = (unsigned char)rng();
+                v[0] |= 1;
+                checkOperand(v, *key, rng, label);
+            }
+
+            // Limbs of all ones, and a single leading bit
+            vector<unsigned char> ones(size, 0xFF);
+            checkOperand(ones, *key, rng, label + ", all ones");
+            vector<unsigned char> top(size, 0);
+            top[0] = 1;
+            checkOperand(top, *key, rng, label + ", power of two");
+        }
+    }
+}
+
+static void checkTextAnswers()
+{
+    for (const TextAnswer& a : textAnswers)
+    {
+        string label = string("\"") + a.plain + "\" at " + to_string(a.number);
+        if (LockstitchTest::encryptAt(a.plain, a.number) != a.cipher)
+            fail("text encrypt of " + label);
+        if (LockstitchTest::decrypt(a.cipher) != a.plain)
+            fail("text decrypt of " + label);
+    }
+}
+
+static void checkFileAnswers()
+{
+    for (const FileAnswer& a : fileAnswers)
+    {
+        string label = to_string(a.size) + "-byte ." + a.ext + " (header " + to_string(a.headSize) + ") at " + to_string(a.number);
+        vector<unsigned char> plain = pattern(a.size);
+        vector<unsigned char> encrypted = LockstitchTest::encryptData(plain, a.ext, a.headSize, a.number);
+        if (fnv1a(encrypted) != a.hash)
+            fail("file encrypt of " + label);
+
+        vector<unsigned char> decrypted;
+        if (!LockstitchTest::decryptData(encrypted, decrypted, a.ext) || decrypted != plain)
+            fail("file decrypt of " + label);
+    }
+}
+
+int main()
+{
+    checkArithmetic();
+    checkTextAnswers();
+    checkFileAnswers();
+
+    printf("bignum_test: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// load_bench.cpp
+// File-load throughput: the old istream_iterator loader against bulk read and mmap
+//
+// usage: load_bench [size_mb] [file]
+// Without a file argument a temporary file of size_mb (default 64) is created and removed.
+
+#include "FileIO.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define RUNS 5
+
+// Loader used by Lockstitch::loadFile before the bulk read path
+static vector<unsigned char> loadIstreamIterator(const string& path)
+{
+    ifstream file(path, ios::binary);
+    file.unsetf(ios::skipws);
+    file.seekg(0, ios::end);
+    streampos size = file.tellg();
+    file.seekg(0, ios::beg);
+
+    vector<unsigned char> vec;
+    vec.reserve(size);
+    vec.insert(vec.begin(), istream_iterator<unsigned char>(file), istream_iterator<unsigned char>());
+
+    return vec;
+}
+
+static vector<unsigned char> loadIfstreamRead(const string& path)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    vector<unsigned char> vec((size_t)file.tellg());
+    file.seekg(0, ios::beg);
+    file.read((char*)vec.data(), vec.size());
+
+    return vec;
+}
+
+static vector<unsigned char> loadFileReader(const string& path)
+{
+    vector<unsigned char> vec;
+    FileReader(path).readAll(vec);
+
+    return vec;
+}
+
+static vector<unsigned char> loadMmap(const string& path)
+{
+    FileReader file(path);
+    const unsigned char* p = file.map();
+
+    return p ? vector<unsigned char>(p, p + file.size()) : vector<unsigned char>();
+}
+
+static void run(const char* name, const string& path, size_t expected, function<vector<unsigned char>(const string&)> load)
+{
+    double best = 0;
+    for (int i = 0; i < RUNS; ++i)
+    {
+        auto t0 = chrono::steady_clock::now();
+        vector<unsigned char> v = load(path);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (v.size() != expected)
+        {
+            printf("%-20s FAILED (read %zu of %zu bytes)\n", name, v.size(), expected);
+            return;
+        }
+        best = max(best, expected / sec / (1 << 20));
+    }
+    printf("%-20s %10.1f MB/s\n", name, best);
+}
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+    string path = argc > 2 ? argv[2] : "load_bench.tmp";
+    bool temp = argc <= 2;
+
+    if (temp)
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        vector<char> block(1 << 20);
+        unsigned int seed = 1;
+        for (char& c : block)
+            c = (char)(seed = seed * 1103515245 + 12345) >> 16;
+        for (size_t i = 0; i < mb; ++i)
+            out.write(block.data(), block.size());
+    }
+
+    FileReader probe(path);
+    if (!probe.isOpen())
+    {
+        printf("cannot open %s\n", path.c_str());
+        return 1;
+    }
+    size_t size = probe.size();
+    printf("file %s, %zu bytes, best of %d (page cache warm)\n", path.c_str(), size, RUNS);
+
+    run("istream_iterator", path, size, loadIstreamIterator);
+    run("ifstream::read", path, size, loadIfstreamRead);
+    run("FileReader::readAll", path, size, loadFileReader);
+    run("FileReader::map", path, size, loadMmap);
+
+    if (temp)
+        remove(path.c_str());
+
+    return 0;
+}
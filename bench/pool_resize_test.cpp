@@ -0,0 +1,90 @@
+// pool_resize_test.cpp
+// Resizes the shared WorkerPool while 1-8MB file round trips run on other threads.
+// Ranges of up to STREAM_BLOCK_SIZE run inline on the caller and split again inside xorString,
+// so this covers a nested parallelFor while setThreadCount waits for the pool.
+//
+// usage: pool_resize_test [rounds]
+// Exits non-zero on a mismatch or a failed call; a deadlock shows up as the ctest timeout.
+
+#include "Lockstitch.h"
+#include "FileIO.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define JOBS 2
+
+static bool writeFile(const string& path, const vector<unsigned char>& data)
+{
+    FileWriter out(path);
+    return out.allocate(data.size()) && out.writeAt(0, data.data(), data.size()) && out.close();
+}
+
+// Encrypts and decrypts path in place, rounds times, checking the plaintext each time
+static bool roundTrips(const string& path, size_t size, int rounds, unsigned seed)
+{
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    mt19937 rng(seed);
+    for (int i = 0; i < rounds; ++i)
+    {
+        vector<unsigned char> plain(size);
+        for (unsigned char& c : plain)
+            c = (unsigned char)rng();
+        // A leading zero byte does not survive the multiply/divide prefix
+        plain[0] |= 1;
+        if (!writeFile(path, plain))
+            return false;
+
+        string encrypted = lock.encryptFile(path, "resize");
+        string decrypted = encrypted == ERROR_FILE_IO_FAILURE ? encrypted : lock.decryptFile(encrypted, "resize");
+        vector<unsigned char> back;
+        if (decrypted != path || !FileReader(path).readAll(back) || back != plain)
+        {
+            fprintf(stderr, "%s: round %d of %zu bytes failed (%s)\n", path.c_str(), i, size, decrypted.c_str());
+            return false;
+        }
+        remove(encrypted.c_str());
+    }
+    remove(path.c_str());
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 6;
+    Lockstitch& lock = Lockstitch::getLockstitch();
+
+    atomic<int> running(JOBS);
+    atomic<bool> failed(false);
+    vector<thread> jobs;
+    for (int j = 0; j < JOBS; ++j)
+    {
+        jobs.emplace_back([&, j]() {
+            string path = "pool_resize_" + to_string(j) + ".bin";
+            size_t size = (j == 0 ? 1 : 6) << 20;
+            if (!roundTrips(path, size + 12345 * j, rounds, 42 + j))
+                failed = true;
+            --running;
+        });
+    }
+
+    size_t counts[] = { 4, 1, 3, 2 };
+    for (size_t i = 0; running > 0; ++i)
+    {
+        lock.setThreadCount(counts[i % 4]);
+        this_thread::yield();
+    }
+    for (thread& t : jobs)
+        t.join();
+    lock.setThreadCount(0);
+
+    printf("pool_resize_test: %s\n", failed ? "FAILED" : "ok");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+// primitives_bench.cpp
+// Google Benchmark suite for the Lockstitch primitives across input sizes and key positions
+//
+// usage: primitives_bench [--benchmark_filter=<regex>] [--benchmark_out=<file> --benchmark_out_format=json]
+// Each benchmark reports bytes_per_second, MB_per_second and ns_per_byte; the JSON output is what
+// regressions are tracked against (the bench_json target writes primitives.json).
+
+#include "Lockstitch.h"
+#include "FileIO.h"
+#include "HexCodec.h"
+#include "Utf8.h"
+#include "Arena.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Key positions: the full 1000-byte key, a mid-table one and the shortest one encrypt can pick
+#define KEY_FULL 1
+#define KEY_MID 1500
+#define KEY_SHORT 2037
+
+// Reaches the private primitives; declared a friend in Lockstitch.h
+class LockstitchBench
+{
+public:
+    static Lockstitch& lock() { return Lockstitch::getLockstitch(); }
+    static shared_ptr<const KeySlice> key(int number) { return lock().getKeySlice(number, FILE_KEY_SIZE); }
+
+    static vector<unsigned char> mulString(vector<unsigned char>& v, const KeySlice& key) { return lock().mulString(v, key); }
+    static vector<unsigned char> divString(vector<unsigned char>& v, const KeySlice& key) { return lock().divString(v, key); }
+    static void xorString(vector<unsigned char>& v, const KeySlice& key) { lock().xorString(v, key); }
+    static string charListToHexString(vector<unsigned char>& v) { return lock().charListToHexString(v); }
+    static vector<unsigned char> charListToHexCharArray(vector<unsigned char>& v) { return lock().charListToHexCharArray(v); }
+    static vector<unsigned char> loadFile(const FileReader& file) { return lock().loadFile(file); }
+
+    // encryptData/decryptData only lay out segments; gathering them is where the XOR happens
+    static string encryptData(const vector<unsigned char>& in, vector<unsigned char>& out, const string& ext)
+    {
+        SegmentList segments;
+        string startLocation = lock().encryptData(in.data(), in.size(), segments, ext);
+        out.resize(segments.total);
+        lock().gatherSegments(segments, out.data());
+        return startLocation;
+    }
+
+    static int decryptData(const vector<unsigned char>& in, vector<unsigned char>& out, const string& ext)
+    {
+        SegmentList segments;
+        if (lock().decryptData(in.data(), in.size(), segments, ext) != 0)
+            return 1;
+        out.resize(segments.total);
+        lock().gatherSegments(segments, out.data());
+        return 0;
+    }
+};
+
+static vector<unsigned char> randomBytes(size_t n)
+{
+    vector<unsigned char> v(n);
+    unsigned int seed = (unsigned int)n + 1;
+    for (unsigned char& c : v)
+        c = (unsigned char)((seed = seed * 1103515245 + 12345) >> 16);
+
+    return v;
+}
+
+static void setThroughput(benchmark::State& state, size_t bytes)
+{
+    state.SetBytesProcessed(state.iterations() * bytes);
+    // Counters are summed over threads; averaging keeps both in line with bytes_per_second in Threads() rows
+    state.counters["MB_per_second"] = benchmark::Counter(bytes * 1e-6, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kAvgThreads);
+    // Inverted rate of bytes * 1e-9 per iteration is nanoseconds per byte
+    state.counters["ns_per_byte"] = benchmark::Counter(bytes * 1e-9, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kAvgThreads | benchmark::Counter::kInvert);
+}
+
+// Args: input bytes (at most the 40 KB mul/div prefix in practice), key position
+static void BM_MulString(benchmark::State& state)
+{
+    vector<unsigned char> in = randomBytes(state.range(0));
+    shared_ptr<const KeySlice> key = LockstitchBench::key(state.range(1));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::mulString(in, *key));
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_MulString)->ArgsProduct({ { 1 << 10, 8 << 10, 40000 }, { KEY_FULL, KEY_MID, KEY_SHORT } })->Unit(benchmark::kMicrosecond);
+
+static void BM_DivString(benchmark::State& state)
+{
+    vector<unsigned char> plain = randomBytes(state.range(0));
+    shared_ptr<const KeySlice> key = LockstitchBench::key(state.range(1));
+    vector<unsigned char> product = LockstitchBench::mulString(plain, *key);
+    vector<unsigned char> in = LockstitchBench::charListToHexCharArray(product);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::divString(in, *key));
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_DivString)->ArgsProduct({ { 1 << 10, 8 << 10, 40000 }, { KEY_FULL, KEY_MID, KEY_SHORT } })->Unit(benchmark::kMicrosecond);
+
+// Heap blocks the arenas took during the timed loop, summed over threads; 0 means the primitives
+// did not call malloc once warm
+static void setArenaBlocks(benchmark::State& state, uint64_t before)
+{
+    state.counters["arena_blocks"] = (double)(Arena::local().blocksTaken() - before);
+}
+
+// Args: plaintext bytes. The text UIs send a few hundred bytes at a time from many requests at once.
+static void BM_EncryptString(benchmark::State& state)
+{
+    vector<unsigned char> bytes = randomBytes(state.range(0));
+    string in(bytes.begin(), bytes.end());
+    LockstitchBench::lock().encrypt(in);
+    uint64_t before = Arena::local().blocksTaken();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::lock().encrypt(in));
+    setArenaBlocks(state, before);
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_EncryptString)->Arg(200)->Arg(4 << 10)->Arg(1 << 20)->Threads(1)->Threads(4)->UseRealTime();
+
+static void BM_DecryptString(benchmark::State& state)
+{
+    vector<unsigned char> bytes = randomBytes(state.range(0));
+    string plain(bytes.begin(), bytes.end());
+    string in = LockstitchBench::lock().encrypt(plain);
+    LockstitchBench::lock().decrypt(in);
+    uint64_t before = Arena::local().blocksTaken();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::lock().decrypt(in));
+    setArenaBlocks(state, before);
+    setThroughput(state, plain.size());
+}
+BENCHMARK(BM_DecryptString)->Arg(200)->Arg(4 << 10)->Arg(1 << 20)->Threads(1)->Threads(4)->UseRealTime();
+
+static void BM_XorString(benchmark::State& state)
+{
+    vector<unsigned char> in = randomBytes(state.range(0));
+    shared_ptr<const KeySlice> key = LockstitchBench::key(state.range(1));
+    for (auto _ : state)
+    {
+        LockstitchBench::xorString(in, *key);
+        benchmark::ClobberMemory();
+    }
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_XorString)->ArgsProduct({ { 4 << 10, 1 << 20, 64 << 20 }, { KEY_FULL, KEY_MID, KEY_SHORT } });
+
+static void BM_CharListToHexString(benchmark::State& state)
+{
+    vector<unsigned char> in = randomBytes(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::charListToHexString(in));
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_CharListToHexString)->Arg(64)->Arg(40000)->Arg(1 << 20);
+
+// Args: decoded bytes; the input is twice as many hex digits
+static void BM_HexDecode(benchmark::State& state)
+{
+    vector<unsigned char> plain = randomBytes(state.range(0));
+    vector<unsigned char> in = LockstitchBench::charListToHexCharArray(plain), out(plain.size());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(HexCodec::decode(in.data(), in.size(), out.data()));
+        benchmark::ClobberMemory();
+    }
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_HexDecode)->Arg(64)->Arg(40000)->Arg(1 << 20);
+
+// Args: UTF-8 bytes, then 0 for ASCII (a path) or 1 for mixed-script text; only the wstring API pays this
+static void BM_Utf8ToWide(benchmark::State& state)
+{
+    const string unit = state.range(1) ? "Lockstitch 加密 ünïcødé 😀 " : "/Users/someone/Documents/";
+    string in;
+    while (in.length() < (size_t)state.range(0))
+        in += unit;
+    wstring out;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Utf8::toWide(in.data(), in.length(), out));
+    setThroughput(state, in.length());
+}
+BENCHMARK(BM_Utf8ToWide)->ArgsProduct({ { 64, 4 << 10, 1 << 20 }, { 0, 1 } });
+
+static void BM_LoadFile(benchmark::State& state)
+{
+    string path = "primitives_bench.tmp";
+    vector<unsigned char> data = randomBytes(state.range(0));
+    ofstream(path, ios::binary | ios::trunc).write((const char*)data.data(), data.size());
+
+    for (auto _ : state)
+    {
+        FileReader file(path);
+        benchmark::DoNotOptimize(LockstitchBench::loadFile(file));
+    }
+    setThroughput(state, data.size());
+    remove(path.c_str());
+}
+BENCHMARK(BM_LoadFile)->Arg(1 << 20)->Arg(64 << 20)->Unit(benchmark::kMillisecond);
+
+// Args: input bytes, 1 for the video (pure XOR) layout
+static void BM_EncryptData(benchmark::State& state)
+{
+    vector<unsigned char> in = randomBytes(state.range(0)), out;
+    string ext = state.range(1) ? "mp4" : "pdf";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LockstitchBench::encryptData(in, out, ext));
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_EncryptData)->ArgsProduct({ { 64 << 10, 1 << 20, 16 << 20 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+
+static void BM_DecryptData(benchmark::State& state)
+{
+    vector<unsigned char> plain = randomBytes(state.range(0)), in, out;
+    string ext = state.range(1) ? "mp4" : "pdf";
+    string startLocation = LockstitchBench::encryptData(plain, in, ext);
+    in.insert(in.end(), startLocation.begin(), startLocation.end());
+    for (auto _ : state)
+    {
+        if (LockstitchBench::decryptData(in, out, ext) != 0)
+        {
+            state.SkipWithError("decryptData failed");
+            break;
+        }
+    }
+    setThroughput(state, in.size());
+}
+BENCHMARK(BM_DecryptData)->ArgsProduct({ { 64 << 10, 1 << 20, 16 << 20 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
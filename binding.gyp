@@ -4,11 +4,30 @@
       "target_name": "lockstitch",
       "sources": [
         "lockstitch_wrapper.cpp",
-        "cpp/LockstitchMacWrapper.cpp"
+        "cpp/LockstitchMacWrapper.cpp",
+        "cpp/BigNum.cpp",
+        "cpp/FileIO.cpp",
+        "cpp/XorKernel.cpp",
+        "cpp/WorkerPool.cpp",
+        "cpp/Arena.cpp",
+        "cpp/JobScheduler.cpp",
+        "cpp/Log.cpp",
+        "cpp/Stats.cpp",
+        "cpp/HexCodec.cpp",
+        "cpp/Utf8.cpp"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")",
-        "cpp"
+        "cpp",
+        "<(SHARED_INTERMEDIATE_DIR)"
+      ],
+      "actions": [
+        {
+          "action_name": "embed_pattern_table",
+          "inputs": ["cpp/code.txt", "scripts/embedPatternTable.js"],
+          "outputs": ["<(SHARED_INTERMEDIATE_DIR)/PatternTable.h"],
+          "action": ["node", "scripts/embedPatternTable.js", "cpp/code.txt", "<(SHARED_INTERMEDIATE_DIR)/PatternTable.h"]
+        }
       ],
       "dependencies": [
         "<!(node -p \"require('node-addon-api').gyp\")"
@@ -21,7 +40,7 @@
         "MACOSX_DEPLOYMENT_TARGET": "10.15",
         "OTHER_CFLAGS": ["-std=c++17"]
       },
-      "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS"]
+      "defines": ["NAPI_DISABLE_CPP_EXCEPTIONS", "LOCKSTITCH_LOG_MAX=LOG_LEVEL_DEBUG"]
     }
   ]
 }
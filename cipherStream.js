@@ -0,0 +1,46 @@
+const { Transform } = require('stream');
+
+// stream.Transform wrappers around the addon's native Cipher.
+//
+// Encryption starts emitting once the header and the 40 KB mul/div prefix have arrived, then passes
+// every chunk straight through; each chunk is processed off the event loop. Decryption is not
+// streaming: the key position and password are stored at the end of the data, so it buffers its
+// input (at most maxInput bytes, else a RangeError) and emits everything on flush, after an
+// 'extension' event carrying the original file extension.
+module.exports = (lockstitch) => {
+  class CipherStream extends Transform {
+    constructor(cipher, options) {
+      super(options);
+      this.cipher = cipher;
+    }
+
+    _transform(chunk, encoding, callback) {
+      this.cipher.update(chunk).then((output) => {
+        if (output.length) {
+          this.push(output);
+        }
+        callback();
+      }, callback);
+    }
+
+    _flush(callback) {
+      this.cipher.final().then((result) => {
+        if (Buffer.isBuffer(result)) {
+          this.push(result);
+        } else {
+          this.emit('extension', result.extension);
+          this.push(result.data);
+        }
+        callback();
+      }, callback);
+    }
+  }
+
+  const createEncryptStream = ({ extension = '', password, headSize = 0 }, options) =>
+    new CipherStream(new lockstitch.Cipher('encrypt', extension, password, headSize), options);
+
+  const createDecryptStream = ({ password, maxInput = 0 }, options) =>
+    new CipherStream(new lockstitch.Cipher('decrypt', password, maxInput), options);
+
+  return { createEncryptStream, createDecryptStream };
+};
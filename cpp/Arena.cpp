@@ -0,0 +1,151 @@
+// Arena.cpp
+// Per-thread scratch memory for the Lockstitch primitives
+
+#include "Arena.h"
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sys/mman.h>
+
+using namespace std;
+
+static atomic<uint64_t> s_allocs(0);
+static atomic<uint64_t> s_bytes(0);
+static atomic<uint64_t> s_blocks(0);
+static atomic<uint64_t> s_blockBytes(0);
+static atomic<uint64_t> s_hugeBlocks(0);
+static atomic<uint64_t> s_retained(0);
+
+static bool hugePagesEnabled()
+{
+    static const bool enabled = getenv("LOCKSTITCH_HUGE_PAGES") && strcmp(getenv("LOCKSTITCH_HUGE_PAGES"), "1") == 0;
+    return enabled;
+}
+
+Arena& Arena::local()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+Arena::~Arena()
+{
+    for (const Block& block : m_blocks)
+        freeBlock(block);
+}
+
+void* Arena::alloc(size_t bytes, size_t align)
+{
+    s_allocs.fetch_add(1, memory_order_relaxed);
+    s_bytes.fetch_add(bytes, memory_order_relaxed);
+
+    for (;;)
+    {
+        if (m_current < m_blocks.size())
+        {
+            Block& block = m_blocks[m_current];
+            uintptr_t base = (uintptr_t)block.data;
+            size_t start = ((base + m_used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+            if (start <= block.size && bytes <= block.size - start)
+            {
+                m_used = start + bytes;
+                return block.data + start;
+            }
+
+            // The rest of a block that is too small stays unused until the scope closes
+            if (m_current + 1 < m_blocks.size())
+            {
+                ++m_current;
+                m_used = 0;
+                continue;
+            }
+        }
+        grow(bytes + align);
+    }
+}
+
+void Arena::release(Mark mark)
+{
+    m_current = mark.block;
+    m_used = mark.used;
+
+    // Only the outermost scope trims, so no live allocation can sit in a freed block
+    if (mark.block != 0 || mark.used != 0)
+        return;
+    while (m_retained > ARENA_RETAIN && !m_blocks.empty())
+    {
+        m_retained -= m_blocks.back().size;
+        freeBlock(m_blocks.back());
+        m_blocks.pop_back();
+    }
+}
+
+void Arena::grow(size_t bytes)
+{
+    size_t size = max((size_t)ARENA_MIN_BLOCK, m_blocks.empty() ? 0 : m_blocks.back().size * 2);
+    size = max(size, bytes);
+
+    Block block = { nullptr, size, false };
+#ifdef MADV_HUGEPAGE
+    if (size >= ARENA_HUGE_BLOCK && hugePagesEnabled())
+    {
+        size_t mapped = (size + ARENA_HUGE_BLOCK - 1) & ~(size_t)(ARENA_HUGE_BLOCK - 1);
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            madvise(p, mapped, MADV_HUGEPAGE);
+            block = { (unsigned char*)p, mapped, true };
+            s_hugeBlocks.fetch_add(1, memory_order_relaxed);
+        }
+    }
+#endif
+    if (!block.data)
+    {
+        block.data = (unsigned char*)malloc(size);
+        if (!block.data)
+            throw bad_alloc();
+    }
+
+    m_blocks.push_back(block);
+    m_current = m_blocks.size() - 1;
+    m_used = 0;
+    m_retained += block.size;
+    ++m_blocksTaken;
+    s_blocks.fetch_add(1, memory_order_relaxed);
+    s_blockBytes.fetch_add(block.size, memory_order_relaxed);
+    s_retained.fetch_add(block.size, memory_order_relaxed);
+}
+
+void Arena::freeBlock(const Block& block)
+{
+    s_retained.fetch_sub(block.size, memory_order_relaxed);
+    if (block.mapped)
+        munmap(block.data, block.size);
+    else
+        free(block.data);
+}
+
+ArenaStats Arena::stats()
+{
+    ArenaStats s;
+    s.allocs = s_allocs.load(memory_order_relaxed);
+    s.bytes = s_bytes.load(memory_order_relaxed);
+    s.blocks = s_blocks.load(memory_order_relaxed);
+    s.blockBytes = s_blockBytes.load(memory_order_relaxed);
+    s.hugeBlocks = s_hugeBlocks.load(memory_order_relaxed);
+    s.retainedBytes = s_retained.load(memory_order_relaxed);
+
+    return s;
+}
+
+// Everything but retainedBytes, which is a level rather than a count
+void Arena::resetStats()
+{
+    s_allocs.store(0, memory_order_relaxed);
+    s_bytes.store(0, memory_order_relaxed);
+    s_blocks.store(0, memory_order_relaxed);
+    s_blockBytes.store(0, memory_order_relaxed);
+    s_hugeBlocks.store(0, memory_order_relaxed);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// Blocks grow from this size, doubling
+#define ARENA_MIN_BLOCK (64 << 10)
+// Blocks at least this large may be huge-page backed (LOCKSTITCH_HUGE_PAGES=1)
+#define ARENA_HUGE_BLOCK (2 << 20)
+// A thread keeps at most this much once its outermost scope closes. Every pool, lane and libuv
+// thread has an arena, so this is paid once per thread; larger jobs go back to the heap after use.
+#define ARENA_RETAIN (4 << 20)
+
+struct ArenaStats
+{
+	uint64_t allocs;		// scratch allocations served
+	uint64_t bytes;
+	uint64_t blocks;		// blocks taken from the heap (or mmap); flat in the steady state
+	uint64_t blockBytes;
+	uint64_t hugeBlocks;
+	uint64_t retainedBytes;	// held by all threads right now
+};
+
+// Per-thread bump allocator for the scratch space of the Lockstitch primitives.
+// Space is taken inside an ArenaScope and handed back all at once when the scope closes, so once
+// a thread has seen its largest request it keeps reusing the same blocks and never calls malloc.
+// Memory from alloc() must not outlive the innermost open scope.
+class Arena
+{
+public:
+	// This thread's arena
+	static Arena& local();
+
+	~Arena();
+
+	void* alloc(size_t bytes, size_t align = 16);
+	template <typename T> T* alloc(size_t n) { return (T*)alloc(n * sizeof(T), alignof(T) < 16 ? 16 : alignof(T)); }
+
+	struct Mark
+	{
+		size_t block;
+		size_t used;
+	};
+	Mark mark() const { return { m_current, m_used }; }
+	void release(Mark mark);
+
+	// Blocks this thread's arena has taken so far
+	uint64_t blocksTaken() const { return m_blocksTaken; }
+
+	static ArenaStats stats();
+	static void resetStats();
+
+private:
+	Arena() {}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	struct Block
+	{
+		unsigned char* data;
+		size_t size;
+		bool mapped;
+	};
+
+	void grow(size_t bytes);
+	static void freeBlock(const Block& block);
+
+	vector<Block> m_blocks;
+	size_t m_current = 0;
+	size_t m_used = 0;
+	size_t m_retained = 0;
+	uint64_t m_blocksTaken = 0;
+};
+
+// Returns everything allocated from the thread's arena while it was open
+class ArenaScope
+{
+public:
+	ArenaScope() : m_arena(Arena::local()), m_mark(m_arena.mark()) {}
+	~ArenaScope() { m_arena.release(m_mark); }
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	template <typename T> T* alloc(size_t n) { return m_arena.alloc<T>(n); }
+
+private:
+	Arena& m_arena;
+	Arena::Mark m_mark;
+};
@@ -0,0 +1,433 @@
+// BigNum.cpp
+// Word-level multiprecision arithmetic for the Lockstitch mul/div transforms
+
+#include "BigNum.h"
+#include "HexCodec.h"
+#include "Arena.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+typedef unsigned __int128 dlimb_t;
+
+// Below this many limbs schoolbook beats Karatsuba
+#define KARATSUBA_THRESHOLD 32
+
+vector<limb_t> BigNum::fromBytes(const unsigned char* data, size_t len)
+{
+    vector<limb_t> a((len + 7) / 8);
+    fromBytes(data, len, a.data());
+
+    return a;
+}
+
+void BigNum::fromBytes(const unsigned char* data, size_t len, limb_t* a)
+{
+    // Whole limbs from the end, then the short most significant one
+    size_t k = 0;
+    for (; (k + 1) * 8 <= len; ++k)
+    {
+        limb_t v;
+        memcpy(&v, data + len - (k + 1) * 8, 8);
+        a[k] = __builtin_bswap64(v);
+    }
+    if (len % 8)
+    {
+        a[k] = 0;
+        for (size_t i = 0; i < len - k * 8; ++i)
+            a[k] = (a[k] << 8) | data[i];
+    }
+}
+
+bool BigNum::fromHex(const unsigned char* hex, size_t len, limb_t* out)
+{
+    ArenaScope scope;
+    unsigned char* bytes = scope.alloc<unsigned char>((len + 1) / 2);
+    bool ok = HexCodec::decode(hex, len, bytes);
+    fromBytes(bytes, (len + 1) / 2, out);
+
+    return ok;
+}
+
+void BigNum::toBytes(const limb_t* a, size_t an, unsigned char* out, size_t len)
+{
+    // Whole limbs into the end, then the bytes of the most significant part
+    size_t k = 0;
+    for (; k < an && (k + 1) * 8 <= len; ++k)
+    {
+        limb_t v = __builtin_bswap64(a[k]);
+        memcpy(out + len - (k + 1) * 8, &v, 8);
+    }
+    for (size_t i = 0; i < len - k * 8; ++i)
+    {
+        size_t bit = (len - k * 8 - 1 - i) * 8;
+        size_t j = k + bit / 64;
+        out[i] = j < an ? (unsigned char)(a[j] >> (bit % 64)) : 0;
+    }
+}
+
+size_t BigNum::byteLength(const limb_t* a, size_t an)
+{
+    size_t n = an;
+    while (n > 0 && a[n - 1] == 0)
+        --n;
+    if (n == 0)
+        return 0;
+
+    size_t bytes = (n - 1) * 8;
+    for (limb_t top = a[n - 1]; top; top >>= 8)
+        ++bytes;
+
+    return bytes;
+}
+
+void BigNum::mul(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* r)
+{
+    if (an < bn)
+    {
+        swap(a, b);
+        swap(an, bn);
+    }
+
+    switch (bn)
+    {
+    case 1: mulFixed<1>(a, an, b, r); return;
+    case 2: mulFixed<2>(a, an, b, r); return;
+    case 3: mulFixed<3>(a, an, b, r); return;
+    case 4: mulFixed<4>(a, an, b, r); return;
+    }
+
+    if (bn < KARATSUBA_THRESHOLD)
+    {
+        mulSchoolbook(a, an, b, bn, r);
+        return;
+    }
+
+    if (an == bn)
+    {
+        mulKaratsuba(a, b, an, r);
+        return;
+    }
+
+    // Unbalanced operands: multiply b by bn-limb slices of a and accumulate
+    memset(r, 0, (an + bn) * sizeof(limb_t));
+    ArenaScope scope;
+    limb_t* t = scope.alloc<limb_t>(2 * bn);
+    for (size_t off = 0; off < an; off += bn)
+    {
+        size_t len = min(bn, an - off);
+        mul(a + off, len, b, bn, t);
+        addInto(r + off, an + bn - off, t, len + bn);
+    }
+}
+
+// One pass over a; w holds the unfinished limbs j..j+N-1 of the product
+template <size_t N>
+void BigNum::mulFixed(const limb_t* a, size_t an, const limb_t* b, limb_t* r)
+{
+    limb_t m[N];
+    limb_t w[N] = {};
+    for (size_t k = 0; k < N; ++k)
+        m[k] = b[k];
+
+    for (size_t j = 0; j < an; ++j)
+    {
+        limb_t carry = 0;
+        for (size_t k = 0; k < N; ++k)
+        {
+            dlimb_t t = (dlimb_t)a[j] * m[k] + w[k] + carry;
+            w[k] = (limb_t)t;
+            carry = (limb_t)(t >> 64);
+        }
+        r[j] = w[0];
+        for (size_t k = 0; k + 1 < N; ++k)
+            w[k] = w[k + 1];
+        w[N - 1] = carry;
+    }
+    for (size_t k = 0; k < N; ++k)
+        r[an + k] = w[k];
+}
+
+void BigNum::mulSchoolbook(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* r)
+{
+    memset(r, 0, (an + bn) * sizeof(limb_t));
+    for (size_t i = 0; i < bn; ++i)
+    {
+        limb_t carry = 0;
+        limb_t m = b[i];
+        if (m == 0)
+            continue;
+
+        for (size_t j = 0; j < an; ++j)
+        {
+            dlimb_t t = (dlimb_t)a[j] * m + r[i + j] + carry;
+            r[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> 64);
+        }
+        r[i + an] = carry;
+    }
+}
+
+// r[0, 2n) = a * b for two n-limb operands
+void BigNum::mulKaratsuba(const limb_t* a, const limb_t* b, size_t n, limb_t* r)
+{
+    size_t h = n / 2;
+    size_t k = n - h;
+
+    // z0 and z2 land directly in the low and high halves of r
+    mul(a, h, b, h, r);
+    mul(a + h, k, b + h, k, r + 2 * h);
+
+    ArenaScope scope;
+    limb_t* sa = scope.alloc<limb_t>(k + 1);
+    limb_t* sb = scope.alloc<limb_t>(k + 1);
+    memcpy(sa, a + h, k * sizeof(limb_t));
+    memcpy(sb, b + h, k * sizeof(limb_t));
+    sa[k] = addInto(sa, k, a, h);
+    sb[k] = addInto(sb, k, b, h);
+
+    // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    size_t zn = 2 * (k + 1);
+    limb_t* z1 = scope.alloc<limb_t>(zn);
+    mul(sa, k + 1, sb, k + 1, z1);
+    subInto(z1, zn, r, 2 * h);
+    subInto(z1, zn, r + 2 * h, 2 * k);
+
+    while (zn > 0 && z1[zn - 1] == 0)
+        --zn;
+    addInto(r + h, 2 * n - h, z1, zn);
+}
+
+// r += a with an <= rn; returns the carry out of r
+limb_t BigNum::addInto(limb_t* r, size_t rn, const limb_t* a, size_t an)
+{
+    limb_t carry = 0;
+    size_t i = 0;
+    for (; i < an; ++i)
+    {
+        dlimb_t t = (dlimb_t)r[i] + a[i] + carry;
+        r[i] = (limb_t)t;
+        carry = (limb_t)(t >> 64);
+    }
+    for (; carry && i < rn; ++i)
+        carry = ++r[i] == 0;
+
+    return carry;
+}
+
+// r -= a with an <= rn; returns the borrow out of r
+limb_t BigNum::subInto(limb_t* r, size_t rn, const limb_t* a, size_t an)
+{
+    limb_t borrow = 0;
+    size_t i = 0;
+    for (; i < an; ++i)
+    {
+        limb_t x = r[i];
+        limb_t d = x - a[i] - borrow;
+        borrow = (x < a[i]) || (x - a[i] < borrow);
+        r[i] = d;
+    }
+    for (; borrow && i < rn; ++i)
+        borrow = r[i]-- == 0;
+
+    return borrow;
+}
+
+bool BigNum::makeDivisor(const vector<limb_t>& d, BigDivisor& out)
+{
+    size_t n = d.size();
+    while (n > 0 && d[n - 1] == 0)
+        --n;
+    if (n == 0)
+        return false;
+
+    int s = __builtin_clzll(d[n - 1]);
+    out.shift = s;
+    out.norm.assign(n, 0);
+    for (size_t i = n - 1; i > 0; --i)
+        out.norm[i] = s ? (d[i] << s) | (d[i - 1] >> (64 - s)) : d[i];
+    out.norm[0] = d[0] << s;
+
+    limb_t top = out.norm[n - 1];
+    out.reciprocal = (limb_t)((((dlimb_t)~top) << 64 | ~(limb_t)0) / top);
+
+    // Moller-Granlund, "Improved division by invariant integers", Algorithm 6
+    if (n == 2)
+    {
+        limb_t d1 = out.norm[1], d0 = out.norm[0];
+        limb_t v = out.reciprocal;
+        limb_t p = d1 * v + d0;
+        if (p < d0)
+        {
+            --v;
+            if (p >= d1)
+            {
+                --v;
+                p -= d1;
+            }
+            p -= d1;
+        }
+        dlimb_t t = (dlimb_t)v * d0;
+        limb_t t1 = (limb_t)(t >> 64), t0 = (limb_t)t;
+        p += t1;
+        if (p < t1)
+        {
+            --v;
+            if (p > d1 || (p == d1 && t0 >= d0))
+                --v;
+        }
+        out.reciprocal3 = v;
+    }
+
+    return true;
+}
+
+// Moller-Granlund 2-by-1 division by a normalized d with precomputed reciprocal v; requires u1 < d
+limb_t BigNum::div2by1(limb_t u1, limb_t u0, limb_t d, limb_t v, limb_t& r)
+{
+    dlimb_t q = (dlimb_t)v * u1 + (((dlimb_t)u1 << 64) | u0);
+    limb_t q1 = (limb_t)(q >> 64) + 1;
+    limb_t q0 = (limb_t)q;
+    r = u0 - q1 * d;
+    if (r > q0)
+    {
+        --q1;
+        r += d;
+    }
+    if (r >= d)
+    {
+        ++q1;
+        r -= d;
+    }
+
+    return q1;
+}
+
+// Moller-Granlund 3-by-2 division by a normalized (d1, d0) with reciprocal v; requires (u2, u1) < (d1, d0)
+limb_t BigNum::div3by2(limb_t u2, limb_t u1, limb_t u0, limb_t d1, limb_t d0, limb_t v, limb_t& r1, limb_t& r0)
+{
+    dlimb_t d = ((dlimb_t)d1 << 64) | d0;
+    dlimb_t q = (dlimb_t)v * u2 + (((dlimb_t)u2 << 64) | u1);
+    limb_t q1 = (limb_t)(q >> 64);
+    limb_t q0 = (limb_t)q;
+    limb_t top = u1 - q1 * d1;
+    dlimb_t r = (((dlimb_t)top << 64) | u0) - (dlimb_t)q1 * d0 - d;
+    ++q1;
+    if ((limb_t)(r >> 64) >= q0)
+    {
+        --q1;
+        r += d;
+    }
+    if (r >= d)
+    {
+        ++q1;
+        r -= d;
+    }
+    r1 = (limb_t)(r >> 64);
+    r0 = (limb_t)r;
+
+    return q1;
+}
+
+// One- and two-limb divisors, most significant limb first; the normalizing shift is applied
+// to each limb of a as it is read
+size_t BigNum::divSmall(const limb_t* a, size_t an, const BigDivisor& d, limb_t* q)
+{
+    int s = d.shift;
+    auto shifted = [&](size_t i) { return s ? (a[i] << s) | (i ? a[i - 1] >> (64 - s) : 0) : a[i]; };
+    limb_t top = s ? a[an - 1] >> (64 - s) : 0;
+
+    if (d.norm.size() == 1)
+    {
+        limb_t r = top;
+        for (size_t j = an; j-- > 0;)
+            q[j] = div2by1(r, shifted(j), d.norm[0], d.reciprocal, r);
+
+        return an;
+    }
+
+    // The shifted top limbs are below the divisor, whose high bit is set
+    limb_t d1 = d.norm[1], d0 = d.norm[0];
+    limb_t r1 = top, r0 = shifted(an - 1);
+    for (size_t j = an - 1; j-- > 0;)
+        q[j] = div3by2(r1, r0, shifted(j), d1, d0, d.reciprocal3, r1, r0);
+
+    return an - 1;
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1 Algorithm D
+size_t BigNum::div(const limb_t* a, size_t an, const BigDivisor& d, limb_t* q)
+{
+    const vector<limb_t>& v = d.norm;
+    size_t n = v.size();
+    while (an > 0 && a[an - 1] == 0)
+        --an;
+    if (n == 0 || an < n)
+        return 0;
+    if (n <= 2)
+        return divSmall(a, an, d, q);
+
+    // u = a << shift, one limb longer than a
+    int s = d.shift;
+    ArenaScope scope;
+    limb_t* u = scope.alloc<limb_t>(an + 1);
+    u[an] = s ? a[an - 1] >> (64 - s) : 0;
+    for (size_t i = an - 1; i > 0; --i)
+        u[i] = s ? (a[i] << s) | (a[i - 1] >> (64 - s)) : a[i];
+    u[0] = a[0] << s;
+
+    size_t m = an - n;
+    limb_t d1 = v[n - 1];
+    limb_t d0 = v[n - 2];
+    for (size_t j = m + 1; j-- > 0;)
+    {
+        limb_t u2 = u[j + n];
+        limb_t u1 = u[j + n - 1];
+        limb_t u0 = u[j + n - 2];
+
+        limb_t qhat, rhat;
+        bool overflow = false;
+        if (u2 >= d1)
+        {
+            qhat = ~(limb_t)0;
+            rhat = u1 + d1;
+            overflow = rhat < d1;
+        }
+        else
+            qhat = div2by1(u2, u1, d1, d.reciprocal, rhat);
+
+        while (!overflow && (dlimb_t)qhat * d0 > (((dlimb_t)rhat << 64) | u0))
+        {
+            --qhat;
+            rhat += d1;
+            overflow = rhat < d1;
+        }
+
+        // u[j, j + n] -= qhat * v
+        limb_t carry = 0;
+        limb_t borrow = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            dlimb_t p = (dlimb_t)qhat * v[i] + carry;
+            carry = (limb_t)(p >> 64);
+            limb_t lo = (limb_t)p;
+            limb_t x = u[i + j];
+            limb_t t = x - lo - borrow;
+            borrow = (x < lo) || (x - lo < borrow);
+            u[i + j] = t;
+        }
+        limb_t x = u[j + n];
+        u[j + n] = x - carry - borrow;
+        bool negative = (x < carry) || (x - carry < borrow);
+
+        if (negative)
+        {
+            --qhat;
+            addInto(u + j, n + 1, v.data(), n);
+        }
+        q[j] = qhat;
+    }
+
+    return m + 1;
+}
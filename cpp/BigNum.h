@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// 64-bit limb multiprecision arithmetic used by Lockstitch::mulString/divString.
+// Numbers are stored little-endian (limb 0 is the least significant).
+typedef uint64_t limb_t;
+
+// Divisor prepared once for Knuth Algorithm D
+struct BigDivisor
+{
+	vector<limb_t> norm;	// divisor shifted so the top limb has its high bit set
+	int shift = 0;
+	limb_t reciprocal = 0;	// floor((B^2 - 1) / norm.back()) - B
+	limb_t reciprocal3 = 0;	// floor((B^3 - 1) / (norm[1], norm[0])) - B, for two-limb divisors only
+};
+
+// Results go to caller-provided limbs (mulString/divString take them from the thread's Arena);
+// internal scratch comes from the same arena, so none of these call malloc once it is warm.
+class BigNum
+{
+public:
+	// Big-endian byte string -> limbs
+	static vector<limb_t> fromBytes(const unsigned char* data, size_t len);
+	// Same, into (len + 7) / 8 limbs
+	static void fromBytes(const unsigned char* data, size_t len, limb_t* out);
+	// Lowercase hex digits -> (len + 15) / 16 limbs; any other character counts as a zero nibble and makes the result false
+	static bool fromHex(const unsigned char* hex, size_t len, limb_t* out);
+	// Limbs -> big-endian byte string of exactly len bytes (zero padded on the left)
+	static void toBytes(const limb_t* a, size_t an, unsigned char* out, size_t len);
+	// Number of bytes needed to hold a without leading zeros
+	static size_t byteLength(const limb_t* a, size_t an);
+	// r[0, an + bn) = a * b; r must not overlap a or b. Multipliers of up to 4 limbs (the 80-bit
+	// text key is 2) take a single pass over a with the whole multiplier held in registers.
+	static void mul(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* r);
+	// Returns false when d is zero
+	static bool makeDivisor(const vector<limb_t>& d, BigDivisor& out);
+	// floor(a / d) into q, which needs room for an - d.norm.size() + 1 limbs (at least 1);
+	// returns the number of quotient limbs written, 0 when a < d.
+	// One- and two-limb divisors stream over a with one reciprocal division per limb and no scratch.
+	static size_t div(const limb_t* a, size_t an, const BigDivisor& d, limb_t* q);
+
+private:
+	template <size_t N> static void mulFixed(const limb_t* a, size_t an, const limb_t* b, limb_t* r);
+	static void mulSchoolbook(const limb_t* a, size_t an, const limb_t* b, size_t bn, limb_t* r);
+	static void mulKaratsuba(const limb_t* a, const limb_t* b, size_t n, limb_t* r);
+	static limb_t addInto(limb_t* r, size_t rn, const limb_t* a, size_t an);
+	static limb_t subInto(limb_t* r, size_t rn, const limb_t* a, size_t an);
+	static limb_t div2by1(limb_t u1, limb_t u0, limb_t d, limb_t v, limb_t& r);
+	static limb_t div3by2(limb_t u2, limb_t u1, limb_t u0, limb_t d1, limb_t d0, limb_t v, limb_t& r1, limb_t& r0);
+	static size_t divSmall(const limb_t* a, size_t an, const BigDivisor& d, limb_t* q);
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// Read-only file handle for the Lockstitch file paths: bulk positional reads or a sequential mmap
+class FileReader
+{
+public:
+	explicit FileReader(const string& path);
+	~FileReader();
+	FileReader(const FileReader&) = delete;
+	FileReader& operator=(const FileReader&) = delete;
+
+	bool isOpen() const { return m_fd >= 0; }
+	size_t size() const { return m_size; }
+
+	// Reads up to len bytes at offset; returns the number of bytes read
+	size_t readAt(size_t offset, void* buf, size_t len) const;
+	// Whole file in one pre-sized read
+	bool readAll(vector<unsigned char>& out) const;
+	bool readAll(string& out) const;
+	// Whole file mapped read-only with MADV_SEQUENTIAL; nullptr on failure or for empty files
+	const unsigned char* map();
+
+private:
+	int m_fd;
+	size_t m_size;
+	void* m_map;
+};
+
+// Output file of known final size: allocated up front, then filled by positional writes,
+// which may come from several threads at once for disjoint ranges
+class FileWriter
+{
+public:
+	// Creates or truncates path
+	explicit FileWriter(const string& path);
+	~FileWriter();
+	FileWriter(const FileWriter&) = delete;
+	FileWriter& operator=(const FileWriter&) = delete;
+
+	bool isOpen() const { return m_fd >= 0; }
+
+	// Sets the file to exactly size bytes, reserving its blocks where the filesystem allows
+	bool allocate(size_t size);
+	// Writes all len bytes at offset
+	bool writeAt(size_t offset, const void* buf, size_t len) const;
+	// False if the file could not be opened or closed cleanly
+	bool close();
+
+private:
+	int m_fd;
+};
@@ -0,0 +1,347 @@
+// HexCodec.cpp
+// Vectorized hex encode/decode with runtime dispatch and a portable fallback
+
+#include "HexCodec.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_CODEC_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HEX_CODEC_NEON
+#endif
+
+using namespace std;
+
+static const unsigned char hexDigits[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+
+// Digit value, or 0x10 for a character that is not a lowercase hex digit
+struct HexTable
+{
+    unsigned char value[256];
+
+    constexpr HexTable() : value()
+    {
+        for (int c = 0; c < 256; ++c)
+            value[c] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0x10;
+    }
+};
+
+static constexpr HexTable hexTable;
+
+static void encodeScalar(const unsigned char* in, size_t n, unsigned char* out)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[2 * i] = hexDigits[in[i] >> 4];
+        out[2 * i + 1] = hexDigits[in[i] & 0xF];
+    }
+}
+
+// Decodes whole digit pairs; bad collects the 0x10 flag of every invalid digit
+static void decodePairs(const unsigned char* hex, size_t pairs, unsigned char* out, unsigned& bad)
+{
+    for (size_t i = 0; i < pairs; ++i)
+    {
+        unsigned hi = hexTable.value[hex[2 * i]], lo = hexTable.value[hex[2 * i + 1]];
+        bad |= hi | lo;
+        out[i] = (unsigned char)(((hi & 0xF) << 4) | (lo & 0xF));
+    }
+}
+
+static bool decodeScalar(const unsigned char* hex, size_t n, unsigned char* out)
+{
+    unsigned bad = 0;
+    if (n & 1)
+    {
+        unsigned lo = hexTable.value[*hex++];
+        bad |= lo;
+        *out++ = (unsigned char)(lo & 0xF);
+        --n;
+    }
+    decodePairs(hex, n / 2, out, bad);
+
+    return !(bad & 0x10);
+}
+
+#ifdef HEX_CODEC_X86
+// Nibbles (0-15 per byte) -> ASCII digits
+static inline __m128i nibblesToHexSse2(__m128i v)
+{
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(v, _mm_set1_epi8('0')), letter);
+}
+
+static void encodeSse2(const unsigned char* in, size_t n, unsigned char* out)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+        __m128i lo = _mm_and_si128(x, mask);
+        _mm_storeu_si128((__m128i*)(out + 2 * i), nibblesToHexSse2(_mm_unpacklo_epi8(hi, lo)));
+        _mm_storeu_si128((__m128i*)(out + 2 * i + 16), nibblesToHexSse2(_mm_unpackhi_epi8(hi, lo)));
+    }
+    encodeScalar(in + i, n - i, out + 2 * i);
+}
+
+// ASCII digits -> nibbles; bad gets 0xFF in every lane that is not a lowercase hex digit
+static inline __m128i hexToNibblesSse2(__m128i c, __m128i& bad)
+{
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(c, _mm_set1_epi8('a'));
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+    bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+
+    return _mm_or_si128(_mm_and_si128(d, isDigit), _mm_and_si128(_mm_add_epi8(l, _mm_set1_epi8(10)), isLetter));
+}
+
+// Pairs of nibbles (high first) in 16-bit lanes -> one byte value per lane
+static inline __m128i joinNibblesSse2(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(v, 8));
+}
+
+static bool decodeSse2(const unsigned char* hex, size_t n, unsigned char* out)
+{
+    unsigned bad = 0;
+    if (n & 1)
+    {
+        unsigned lo = hexTable.value[*hex++];
+        bad |= lo;
+        *out++ = (unsigned char)(lo & 0xF);
+        --n;
+    }
+
+    __m128i badLanes = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m128i a = hexToNibblesSse2(_mm_loadu_si128((const __m128i*)(hex + i)), badLanes);
+        __m128i b = hexToNibblesSse2(_mm_loadu_si128((const __m128i*)(hex + i + 16)), badLanes);
+        _mm_storeu_si128((__m128i*)(out + i / 2), _mm_packus_epi16(joinNibblesSse2(a), joinNibblesSse2(b)));
+    }
+    decodePairs(hex + i, (n - i) / 2, out + i / 2, bad);
+
+    return !(bad & 0x10) && _mm_movemask_epi8(badLanes) == 0;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i nibblesToHexAvx2(__m256i v)
+{
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(9)), _mm256_set1_epi8('a' - '0' - 10));
+    return _mm256_add_epi8(_mm256_add_epi8(v, _mm256_set1_epi8('0')), letter);
+}
+
+__attribute__((target("avx2")))
+static void encodeAvx2(const unsigned char* in, size_t n, unsigned char* out)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+        __m256i lo = _mm256_and_si256(x, mask);
+        // Unpacking works within 128-bit lanes; a holds bytes 0-7 and 16-23, b bytes 8-15 and 24-31
+        __m256i a = nibblesToHexAvx2(_mm256_unpacklo_epi8(hi, lo));
+        __m256i b = nibblesToHexAvx2(_mm256_unpackhi_epi8(hi, lo));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    encodeSse2(in + i, n - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hexToNibblesAvx2(__m256i c, __m256i& bad)
+{
+    __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i l = _mm256_sub_epi8(c, _mm256_set1_epi8('a'));
+    __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+    bad = _mm256_or_si256(bad, _mm256_andnot_si256(_mm256_or_si256(isDigit, isLetter), _mm256_set1_epi8(-1)));
+
+    return _mm256_or_si256(_mm256_and_si256(d, isDigit), _mm256_and_si256(_mm256_add_epi8(l, _mm256_set1_epi8(10)), isLetter));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i joinNibblesAvx2(__m256i v)
+{
+    return _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), 4), _mm256_srli_epi16(v, 8));
+}
+
+__attribute__((target("avx2")))
+static bool decodeAvx2(const unsigned char* hex, size_t n, unsigned char* out)
+{
+    unsigned bad = 0;
+    if (n & 1)
+    {
+        unsigned lo = hexTable.value[*hex++];
+        bad |= lo;
+        *out++ = (unsigned char)(lo & 0xF);
+        --n;
+    }
+
+    __m256i badLanes = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m256i a = hexToNibblesAvx2(_mm256_loadu_si256((const __m256i*)(hex + i)), badLanes);
+        __m256i b = hexToNibblesAvx2(_mm256_loadu_si256((const __m256i*)(hex + i + 32)), badLanes);
+        // Packing also works within lanes; reorder the 64-bit quarters back to a0 a1 b0 b1
+        __m256i packed = _mm256_packus_epi16(joinNibblesAvx2(a), joinNibblesAvx2(b));
+        _mm256_storeu_si256((__m256i*)(out + i / 2), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    return decodeSse2(hex + i, n - i, out + i / 2) && !(bad & 0x10) && _mm256_movemask_epi8(badLanes) == 0;
+}
+#endif
+
+#ifdef HEX_CODEC_NEON
+static void encodeNeon(const unsigned char* in, size_t n, unsigned char* out)
+{
+    const uint8x16_t digits = vld1q_u8(hexDigits);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t x = vld1q_u8(in + i);
+        uint8x16x2_t pair;
+        pair.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(x, 4));
+        pair.val[1] = vqtbl1q_u8(digits, vandq_u8(x, vdupq_n_u8(0x0F)));
+        vst2q_u8(out + 2 * i, pair);
+    }
+    encodeScalar(in + i, n - i, out + 2 * i);
+}
+
+static inline uint8x16_t hexToNibblesNeon(uint8x16_t c, uint8x16_t& bad)
+{
+    uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t l = vsubq_u8(c, vdupq_n_u8('a'));
+    uint8x16_t isDigit = vcleq_u8(d, vdupq_n_u8(9));
+    uint8x16_t isLetter = vcleq_u8(l, vdupq_n_u8(5));
+    bad = vorrq_u8(bad, vmvnq_u8(vorrq_u8(isDigit, isLetter)));
+
+    return vorrq_u8(vandq_u8(d, isDigit), vandq_u8(vaddq_u8(l, vdupq_n_u8(10)), isLetter));
+}
+
+static bool decodeNeon(const unsigned char* hex, size_t n, unsigned char* out)
+{
+    unsigned bad = 0;
+    if (n & 1)
+    {
+        unsigned lo = hexTable.value[*hex++];
+        bad |= lo;
+        *out++ = (unsigned char)(lo & 0xF);
+        --n;
+    }
+
+    uint8x16_t badLanes = vdupq_n_u8(0);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        // De-interleaving load: val[0] holds the high digits, val[1] the low ones
+        uint8x16x2_t c = vld2q_u8(hex + i);
+        uint8x16_t hi = hexToNibblesNeon(c.val[0], badLanes);
+        uint8x16_t lo = hexToNibblesNeon(c.val[1], badLanes);
+        vst1q_u8(out + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+    decodePairs(hex + i, (n - i) / 2, out + i / 2, bad);
+
+    return !(bad & 0x10) && vmaxvq_u8(badLanes) == 0;
+}
+#endif
+
+bool HexCodec::find(const string& name, EncodeFn& encode, DecodeFn& decode)
+{
+    if (name == "scalar")
+    {
+        encode = encodeScalar;
+        decode = decodeScalar;
+        return true;
+    }
+#ifdef HEX_CODEC_X86
+    __builtin_cpu_init();
+    if (name == "sse2" && __builtin_cpu_supports("sse2"))
+    {
+        encode = encodeSse2;
+        decode = decodeSse2;
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2"))
+    {
+        encode = encodeAvx2;
+        decode = decodeAvx2;
+        return true;
+    }
+#endif
+#ifdef HEX_CODEC_NEON
+    if (name == "neon")
+    {
+        encode = encodeNeon;
+        decode = decodeNeon;
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+// Widest first
+static const char* const codecNames[] = { "avx2", "sse2", "neon", "scalar" };
+
+struct HexCodecChoice
+{
+    HexCodec::EncodeFn encode = encodeScalar;
+    HexCodec::DecodeFn decode = decodeScalar;
+    const char* name = "scalar";
+
+    HexCodecChoice()
+    {
+        const char* forced = getenv("LOCKSTITCH_HEX_KERNEL");
+        if (!(forced && pick(forced)))
+            pick(nullptr);
+    }
+
+    bool pick(const char* only)
+    {
+        for (const char* candidate : codecNames)
+        {
+            if (only && strcmp(only, candidate) != 0)
+                continue;
+            if (HexCodec::find(candidate, encode, decode))
+            {
+                name = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+static const HexCodecChoice& choice()
+{
+    static const HexCodecChoice c;
+    return c;
+}
+
+void HexCodec::encode(const unsigned char* in, size_t n, unsigned char* out)
+{
+    choice().encode(in, n, out);
+}
+
+bool HexCodec::decode(const unsigned char* hex, size_t n, unsigned char* out)
+{
+    return choice().decode(hex, n, out);
+}
+
+const char* HexCodec::name()
+{
+    return choice().name;
+}
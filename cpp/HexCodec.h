@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// Lowercase hex encode/decode into caller-sized buffers.
+// The widest kernel the CPU supports is picked on first use; LOCKSTITCH_HEX_KERNEL forces one by name.
+class HexCodec
+{
+public:
+	typedef void (*EncodeFn)(const unsigned char* in, size_t n, unsigned char* out);
+	typedef bool (*DecodeFn)(const unsigned char* hex, size_t n, unsigned char* out);
+
+	// Writes 2 * n lowercase digits to out
+	static void encode(const unsigned char* in, size_t n, unsigned char* out);
+	// Writes (n + 1) / 2 bytes to out; an odd leading digit is the low nibble of out[0].
+	// Anything but 0-9 and a-f decodes as a zero nibble, and makes the result false.
+	static bool decode(const unsigned char* hex, size_t n, unsigned char* out);
+	// Name of the kernel encode()/decode() use
+	static const char* name();
+	// "avx2", "sse2", "neon" or "scalar"; false when unsupported here
+	static bool find(const string& name, EncodeFn& encode, DecodeFn& decode);
+};
@@ -0,0 +1,208 @@
+// JobScheduler.cpp
+// Lane scheduler behind the asynchronous Lockstitch calls
+
+#include "JobScheduler.h"
+#include "Stats.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+static const char* const laneNames[LANE_COUNT] = { "text", "file" };
+static const StatPhase laneWaits[LANE_COUNT] = { STAT_TEXT_WAIT, STAT_FILE_WAIT };
+
+static size_t envThreads(const char* name)
+{
+    const char* value = getenv(name);
+    return value ? strtoul(value, nullptr, 10) : 0;
+}
+
+JobScheduler& JobScheduler::shared()
+{
+    static JobScheduler scheduler(envThreads("LOCKSTITCH_TEXT_THREADS"), envThreads("LOCKSTITCH_FILE_THREADS"));
+    return scheduler;
+}
+
+JobScheduler::JobScheduler(size_t textThreads, size_t fileThreads)
+{
+    setThreadCount(LANE_TEXT, textThreads);
+    setThreadCount(LANE_FILE, fileThreads);
+}
+
+// Running jobs finish; queued ones are dropped
+JobScheduler::~JobScheduler()
+{
+    {
+        lock_guard<mutex> lock(m_sleepMutex);
+        m_stopping = true;
+        for (Lane& lane : m_lanes)
+            for (size_t i = 0; i < lane.spawned; ++i)
+                lane.workers[i].wake.notify_one();
+    }
+    for (Lane& lane : m_lanes)
+        for (size_t i = 0; i < lane.spawned; ++i)
+            lane.workers[i].t.join();
+}
+
+size_t JobScheduler::setThreadCount(JobLane laneId, size_t threads)
+{
+    size_t hardware = max(1u, thread::hardware_concurrency());
+    if (threads == 0)
+        threads = laneId == LANE_TEXT ? max((size_t)2, hardware) : max((size_t)1, hardware / 2);
+    threads = min(threads, (size_t)MAX_LANE_THREADS);
+
+    lock_guard<mutex> config(m_configMutex);
+    Lane& lane = m_lanes[laneId];
+    {
+        // Workers past the limit leave the idle list, so submissions only ever wake active ones;
+        // everyone else is woken to re-check which side of the limit it is on
+        lock_guard<mutex> lock(m_sleepMutex);
+        lane.limit = threads;
+        lane.idle.erase(remove_if(lane.idle.begin(), lane.idle.end(), [threads](size_t i) { return i >= threads; }), lane.idle.end());
+        for (size_t i = 0; i < lane.spawned; ++i)
+        {
+            lane.workers[i].signalled = true;
+            lane.workers[i].wake.notify_one();
+        }
+    }
+
+    for (size_t i = lane.spawned; i < threads; ++i)
+    {
+        lane.workers[i].t = thread(&JobScheduler::workerLoop, this, laneId, i);
+        lane.spawned = i + 1;
+    }
+
+    return threads;
+}
+
+void JobScheduler::submit(JobLane laneId, function<void()> fn)
+{
+    Lane& lane = m_lanes[laneId];
+    Worker& target = lane.workers[lane.next++ % lane.limit];
+
+    // Counted before it is visible, so the count never drops below the jobs actually queued
+    ++lane.queued;
+    {
+        lock_guard<mutex> lock(target.m);
+        target.jobs.push_back({ move(fn), chrono::steady_clock::now() });
+    }
+
+    lock_guard<mutex> lock(m_sleepMutex);
+    if (!wakeIdle(laneId) && laneId == LANE_TEXT)
+        wakeIdle(LANE_FILE);
+}
+
+// Called with m_sleepMutex held
+bool JobScheduler::wakeIdle(JobLane laneId)
+{
+    Lane& lane = m_lanes[laneId];
+    if (lane.idle.empty())
+        return false;
+
+    Worker& worker = lane.workers[lane.idle.back()];
+    lane.idle.pop_back();
+    worker.signalled = true;
+    worker.wake.notify_one();
+
+    return true;
+}
+
+bool JobScheduler::hasWork(JobLane laneId, size_t index) const
+{
+    if (index >= m_lanes[laneId].limit)
+        return false;
+
+    return m_lanes[laneId].queued > 0 || (laneId == LANE_FILE && m_lanes[LANE_TEXT].queued > 0);
+}
+
+// Own deque first, then the rest of the lane; file workers fall back to text jobs
+bool JobScheduler::take(JobLane laneId, size_t index, Job& job, JobLane& from)
+{
+    if (index >= m_lanes[laneId].limit)
+        return false;
+
+    from = laneId;
+    if (steal(laneId, index, job))
+        return true;
+
+    from = LANE_TEXT;
+    return laneId == LANE_FILE && steal(LANE_TEXT, index, job);
+}
+
+// Oldest job of the first non-empty deque, scanning from worker first
+bool JobScheduler::steal(JobLane laneId, size_t first, Job& job)
+{
+    Lane& lane = m_lanes[laneId];
+    size_t n = lane.spawned;
+    for (size_t k = 0; k < n && lane.queued > 0; ++k)
+    {
+        Worker& worker = lane.workers[(first + k) % n];
+        lock_guard<mutex> lock(worker.m);
+        if (worker.jobs.empty())
+            continue;
+
+        job = move(worker.jobs.front());
+        worker.jobs.pop_front();
+        --lane.queued;
+        return true;
+    }
+
+    return false;
+}
+
+void JobScheduler::workerLoop(JobLane laneId, size_t index)
+{
+    Lane& lane = m_lanes[laneId];
+    Worker& self = lane.workers[index];
+    for (;;)
+    {
+        Job job;
+        JobLane from;
+        if (take(laneId, index, job, from))
+        {
+            Lane& source = m_lanes[from];
+#ifndef LOCKSTITCH_NO_STATS
+            Stats::record(laneWaits[from], (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - job.queued).count(), 0);
+#endif
+            ++source.running;
+            try {
+                job.fn();
+            }
+            catch (const exception& e) {
+                LOG_ERROR("scheduler: " << laneNames[from] << " job failed: " << e.what());
+            }
+            --source.running;
+            ++source.completed;
+            continue;
+        }
+
+        unique_lock<mutex> lock(m_sleepMutex);
+        if (m_stopping)
+            return;
+        // A submission that landed after the scan has already been counted
+        if (hasWork(laneId, index))
+            continue;
+
+        if (index < lane.limit)
+            lane.idle.push_back(index);
+        self.signalled = false;
+        self.wake.wait(lock, [&] { return m_stopping || self.signalled; });
+
+        auto it = find(lane.idle.begin(), lane.idle.end(), index);
+        if (it != lane.idle.end())
+            lane.idle.erase(it);
+    }
+}
+
+vector<LaneStats> JobScheduler::snapshot() const
+{
+    vector<LaneStats> result;
+    for (int i = 0; i < LANE_COUNT; ++i)
+    {
+        const Lane& lane = m_lanes[i];
+        result.push_back({ laneNames[i], lane.limit, lane.queued, lane.running, lane.completed });
+    }
+
+    return result;
+}
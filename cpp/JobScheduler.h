@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// Lanes of the job scheduler, each with its own worker threads
+enum JobLane
+{
+	LANE_TEXT,	// strings and small buffers
+	LANE_FILE,	// files and large buffers
+	LANE_COUNT
+};
+
+// Jobs on at most this many input bytes go to the text lane
+#define SMALL_JOB_BYTES (64 << 10)
+// Worker slots per lane
+#define MAX_LANE_THREADS 64
+
+struct LaneStats
+{
+	const char* name;
+	size_t threads;
+	size_t queued;
+	size_t running;
+	uint64_t completed;
+};
+
+// Runs whole jobs (one Lockstitch call each) off the JS thread, in lanes, so that a
+// multi-gigabyte file never holds back short text calls. Each worker has its own deque:
+// submissions are spread round-robin over a lane, and idle workers steal from the rest of it.
+// Idle file workers also take text jobs; text workers never take file jobs. Jobs split their own
+// work over their lane's WorkerPool (WorkerPool::forLane), so helper ranges are not shared either.
+// Queue waits are recorded in the textWait/fileWait Stats phases.
+class JobScheduler
+{
+public:
+	// Process-wide scheduler; LOCKSTITCH_TEXT_THREADS and LOCKSTITCH_FILE_THREADS set the initial lane sizes
+	static JobScheduler& shared();
+
+	JobScheduler(size_t textThreads = 0, size_t fileThreads = 0);
+	~JobScheduler();
+	JobScheduler(const JobScheduler&) = delete;
+	JobScheduler& operator=(const JobScheduler&) = delete;
+
+	static JobLane laneFor(size_t bytes) { return bytes <= SMALL_JOB_BYTES ? LANE_TEXT : LANE_FILE; }
+
+	void submit(JobLane lane, function<void()> job);
+
+	// 0 means the lane default: all hardware threads (at least 2) for text, half of them for files.
+	// Returns the count in effect. Shrinking lets running jobs finish; their queues are stolen.
+	size_t setThreadCount(JobLane lane, size_t threads);
+	size_t threadCount(JobLane lane) const { return m_lanes[lane].limit; }
+
+	vector<LaneStats> snapshot() const;
+
+private:
+	struct Job
+	{
+		function<void()> fn;
+		chrono::steady_clock::time_point queued;
+	};
+
+	struct Worker
+	{
+		mutex m;
+		deque<Job> jobs;
+		thread t;
+		condition_variable wake;
+		bool signalled = false;
+	};
+
+	struct Lane
+	{
+		Worker workers[MAX_LANE_THREADS];
+		// Workers with a thread; only grows, so slots below it can always be read
+		atomic<size_t> spawned{ 0 };
+		// Workers below this index take jobs; the rest sleep until the lane grows again
+		atomic<size_t> limit{ 0 };
+		atomic<size_t> queued{ 0 };
+		atomic<size_t> running{ 0 };
+		atomic<uint64_t> completed{ 0 };
+		atomic<size_t> next{ 0 };
+		// Active workers asleep on their own condition variable, guarded by m_sleepMutex
+		vector<size_t> idle;
+	};
+
+	void workerLoop(JobLane lane, size_t index);
+	bool take(JobLane lane, size_t index, Job& job, JobLane& from);
+	bool steal(JobLane lane, size_t first, Job& job);
+	bool hasWork(JobLane lane, size_t index) const;
+	bool wakeIdle(JobLane lane);
+
+	Lane m_lanes[LANE_COUNT];
+	mutex m_sleepMutex;
+	bool m_stopping = false;
+	mutex m_configMutex;
+};
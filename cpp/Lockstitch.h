@@ -2,6 +2,12 @@
 #include <vector>
 //#include <atlstr.h>
 #include<string>
+#include <fstream>
+#include <list>
+#include <memory>
+#include "BigNum.h"
+#include "FileIO.h"
+#include "Arena.h"
 using namespace std;
 #define ERROR_PW_NOT_MATCH "Password incorrect"
 #define ERROR_PW_NOT_MATCH_CN L"密码验证失败"
@@ -9,30 +15,143 @@ using namespace std;
 #define ERROR_DECRYPT_FAIL_CN L"解密失败。请确认你要解密得文件是否已经加密过了"
 #define ERROR_FILE_IO_FAILURE "File I/O failure.  Please double check the wether the file exists or not"
 #define ERROR_FILE_IO_FAILURE_CN L"文件读写失败。请确认该文档是否存在"
+#define TEXT_KEY_SIZE 10
+#define FILE_KEY_SIZE 1000
+#define KEY_STREAM_PAD 64
+
+// Everything derived from one slice of the pattern table, built once per start position
+struct KeySlice
+{
+	string key;
+	vector<limb_t> limbs;
+	BigDivisor divisor;
+	// key repeated so that KEY_STREAM_PAD bytes can be read contiguously from any key offset
+	vector<unsigned char> xorStream;
+};
+
+// One piece of encrypted/decrypted output: a view of bytes that are copied out as they are,
+// or XORed against key from keyOffset on the way out
+struct Segment
+{
+	const unsigned char* data;
+	size_t size;
+	shared_ptr<const KeySlice> key;
+	size_t keyOffset;
+};
+
+// Output of encryptData/decryptData, written in order without first being joined into one buffer.
+// Views point into the input, so it must outlive the list.
+struct SegmentList
+{
+	vector<Segment> parts;
+	// Bytes produced along the way (product, quotient, size words); list nodes never move
+	list<vector<unsigned char>> owned;
+	size_t total = 0;
+
+	void add(const unsigned char* data, size_t size, shared_ptr<const KeySlice> key = nullptr, size_t keyOffset = 0)
+	{
+		if (size == 0)
+			return;
+		parts.push_back({ data, size, key, keyOffset });
+		total += size;
+	}
+	void add(vector<unsigned char> bytes)
+	{
+		owned.push_back(move(bytes));
+		add(owned.back().data(), owned.back().size());
+	}
+};
+
+// Progress of one incremental encryption (Lockstitch::beginEncrypt/encryptUpdate/encryptFinal)
+struct EncryptState
+{
+	string extension;
+	string pw;
+	int headSize = 0;
+	bool video = false;
+	int number = 0;
+	shared_ptr<const KeySlice> key;
+	// Input held back until the header and mul/div prefix are complete
+	vector<unsigned char> pending;
+	bool started = false;
+	// Key offset of the next body byte
+	size_t offset = 0;
+	size_t hexSize = 0;
+};
+
+// Where the parts of a .claudo payload sit, as read from its fixed-size fields (Lockstitch::readLayout)
+struct ClaudoLayout
+{
+	shared_ptr<const KeySlice> key;
+	// Plaintext header stored ahead of the prefix
+	size_t headSize = 0;
+	// Hex product of the multiplied prefix; empty for MP4/MOV
+	size_t prefixOffset = 0;
+	size_t prefixSize = 0;
+	// XORed rest, with key offsets starting at zero
+	size_t bodyOffset = 0;
+	size_t bodySize = 0;
+};
+
+// What Lockstitch::inspectFile learns from the end of a .claudo file
+struct ClaudoInfo
+{
+	string extension;
+	// Where decryptFile would write the plaintext
+	string outputPath;
+	size_t fileSize = 0;
+	ClaudoLayout layout;
+};
+
+// An encrypted file opened for range reads (Lockstitch::openRange/readRange): the prefix is divided
+// once here, so reading the file a range at a time costs only the ranges themselves
+struct ClaudoRange
+{
+	string fileName;
+	ClaudoInfo info;
+	// Plaintext of the prefix; the XORed body follows it
+	vector<unsigned char> quotient;
+	size_t totalSize = 0;
+};
 class Lockstitch
 {
+	// bench/primitives_bench.cpp measures the private primitives directly, and bench/bignum_test.cpp checks them
+	friend class LockstitchBench;
+	friend class LockstitchTest;
+
 	Lockstitch();
 	// Private destructor to prevent external deletion
-	~Lockstitch() {
-		delete instance;
-	}
+	~Lockstitch() {}
 
-	// Private static instance variable
-	static Lockstitch* instance;
 	const char* const prefixData = "@muirp}x";
 	const wchar_t* const prefixData_t = L"@muirp}x";
-	char* password = nullptr;
-	char* password_t = nullptr;
-	string m_constantString;
-	int getPreNumBufSize();
+	// Pattern table; fixed at construction, so every thread reads it without locking
+	const string m_constantString;
+	// Digits in the start location, from the table length
+	const int m_preNumBufSize;
+	// Key material for every start position at both key sizes, built with the table and read without locking
+	const vector<shared_ptr<const KeySlice>> m_textKeys;
+	const vector<shared_ptr<const KeySlice>> m_fileKeys;
+	static string loadPatternTable();
+	vector<shared_ptr<const KeySlice>> makeKeySlices(size_t maxLen) const;
+	// maxLen is TEXT_KEY_SIZE or FILE_KEY_SIZE
+	const shared_ptr<const KeySlice>& getKeySlice(int number, size_t maxLen) const;
+	int getPreNumBufSize() const { return m_preNumBufSize; }
 	string xorString(const char* const str1, const char* const str2, int len)const;
 	wstring xorString(const wchar_t* const str1, const wchar_t* const str2, int len)const;
 	string xorString(const char* const str1, string& str2, int len)const;
 	wstring xorString(const wchar_t* const str1, wstring& str2, int len)const;
 	void xorString(vector<unsigned char>& str1, const string str2);
+	void xorString(vector<unsigned char>& str1, const KeySlice& key);
+	void xorString(unsigned char* data, size_t n, const KeySlice& key, size_t offset);
+	void xorString(const unsigned char* src, unsigned char* dst, size_t n, const KeySlice& key, size_t offset);
 	vector<unsigned char> mulString(vector<unsigned char>& vec, string str);
+	vector<unsigned char> mulString(vector<unsigned char>& vec, const KeySlice& key);
 	vector<unsigned char> divString(string& str1, string str2);
 	vector<unsigned char> divString(vector<unsigned char>& str1, string str2);
+	vector<unsigned char> divString(vector<unsigned char>& str1, const KeySlice& key);
+	void mulBytes(const unsigned char* data, size_t size, const KeySlice& key, unsigned char* out);
+	size_t divHex(const unsigned char* hex, size_t len, const KeySlice& key, ArenaScope& scope, unsigned char*& out);
 
 	vector<unsigned char> stringToCharList(string& cstrw);
 	vector<unsigned char> wstringToCharList(wstring& cstrw);
@@ -40,32 +159,75 @@ class Lockstitch
 	wstring charListToWString(vector<unsigned char>&);
 	string charListToHexString(vector<unsigned char>&);
 	vector<unsigned char> charListToHexCharArray(vector<unsigned char>& arr);
-	vector<unsigned char> loadFile(ifstream& file);
-	int decryptData(vector<unsigned char>&, string fielExtion);
-	string encryptData(vector<unsigned char>& data, string fielExtion = "", int headSize = 0);
+	vector<unsigned char> loadFile(const FileReader& file);
+	string makeTrailer(string extension, string pw);
+	bool readTrailer(const char* trailer, const string& pw, string& extension);
+	int decryptData(const unsigned char* data, size_t size, SegmentList& out, string fielExtion);
+	// number is the key start position; 0 picks one at random, as every caller outside the tests does
+	string encryptData(const unsigned char* data, size_t size, SegmentList& out, string fielExtion = "", int headSize = 0, int number = 0);
+	// encrypt() with the key start position given
+	string encryptAt(const string& content, int number);
+	size_t encryptHead(const unsigned char* data, size_t size, SegmentList& out, const shared_ptr<const KeySlice>& key, bool video, int headSize);
+	vector<unsigned char> encryptTail(bool video, size_t hexSize, int headSize);
+	void startEncrypt(EncryptState& state, vector<unsigned char>& out);
+	void gatherSegments(const SegmentList& segments, unsigned char* out);
+	bool writeSegments(const SegmentList& segments, FileWriter& out, size_t offset);
+	bool encryptStream(const FileReader& in, FileWriter& out, size_t size, string fielExtion, int headSize, const string& trailer);
+	int readLayout(const unsigned char* end, size_t size, string fielExtion, ClaudoLayout& layout);
+	string checkFile(const FileReader& file, const string& pw, string& extension, ClaudoLayout& layout);
+	int decryptStream(const FileReader& in, const ClaudoLayout& layout, FileWriter& out);
+	bool xorCopy(const FileReader& in, size_t inOffset, FileWriter& out, size_t outOffset, size_t count, const KeySlice& key, size_t offset);
+	string getStartLocation(int number);
 	void toUpper(string& s);
-	int getEncodePaterStartPos();
+	int getEncodePaterStartPos() const;
 
 public:
 	Lockstitch(const Lockstitch&) = delete;
 	Lockstitch& operator=(const Lockstitch&) = delete;
+	// Thread-safe lazy construction; all public methods may be called concurrently
 	static Lockstitch& getLockstitch()
 	{
-		if (!instance) {
-			instance = new Lockstitch();
-		}
-		return *instance;
+		static Lockstitch instance;
+		return instance;
 	}
 
 	string encrypt(string& str);
 	wstring encrypt(wstring& wstr);
 	string decrypt(string& str);
 	wstring decrypt(wstring& wstr);
+	// encrypt/decrypt over many strings in one call, in parallel; results are in input order
+	vector<string> encryptStrings(vector<string>& contents);
+	vector<string> decryptStrings(vector<string>& contents);
+	// Paths and passwords are UTF-8; the wstring overloads convert once and call these
 	string encryptFile(string fileName, string pw = "", int headSize = 0);
 	wstring encryptFile(wstring fileName, wstring pw = L"", int headSize = 0);
 	string decryptFile(string fileName, string pw ="");
 	wstring decryptFile(wstring fileName, wstring pw = L"");
+	// Buffer in, buffer out; return "" on success or an ERROR_* message
+	string encryptBuffer(const unsigned char* data, size_t size, vector<unsigned char>& out, string extension, string pw = "", int headSize = 0);
+	string decryptBuffer(const unsigned char* data, size_t size, vector<unsigned char>& out, string& extension, string pw = "");
+	// Plaintext bytes [offset, offset + length) of an encrypted file, clipped to its end, without decrypting the rest.
+	// MP4/MOV bodies are position-keyed XOR, so a range costs only its own bytes; other types also redo the prefix division
+	// on every call, which openRange/readRange below avoid.
+	// totalSize receives the size of the whole plaintext. Returns "" on success or an ERROR_* message.
+	string decryptRange(string fileName, string pw, size_t offset, size_t length, vector<unsigned char>& out, string& extension, size_t& totalSize);
+	// Checks the password and the layout of an encrypted file from its last few dozen bytes, without
+	// reading the payload. Returns "" when decryptFile would get as far as decrypting, or its ERROR_* message.
+	string inspectFile(string fileName, string pw, ClaudoInfo& info);
+	// decryptRange split in two for reading one file a range at a time: openRange checks the file and divides
+	// its prefix, and readRange then serves any number of ranges from it. readRange fails with
+	// ERROR_FILE_IO_FAILURE if the file has changed size since openRange. Both return "" or an ERROR_* message.
+	string openRange(string fileName, string pw, ClaudoRange& range);
+	string readRange(const ClaudoRange& range, size_t offset, size_t length, vector<unsigned char>& out);
+	// encryptBuffer for input that arrives in pieces; the concatenated outputs equal its result.
+	// Decryption has no incremental form: the key position is only known from the end of the data.
+	void beginEncrypt(EncryptState& state, string extension, string pw = "", int headSize = 0);
+	void encryptUpdate(EncryptState& state, const unsigned char* data, size_t size, vector<unsigned char>& out);
+	void encryptFinal(EncryptState& state, vector<unsigned char>& out);
 	string loadTxtFile(string filename);
 	wstring loadTxtFile(wstring filename);
+	// Threads of each lane's helper pool, used for text batches and large XOR passes (0 = all hardware threads);
+	// returns the count in effect
+	size_t setThreadCount(size_t threads);
 };
 
@@ -3,148 +3,187 @@
 // Keeps original source unchanged and wraps it with platform-specific code
 
 #include "Lockstitch.h"
+#include "BigNum.h"
+#include "FileIO.h"
+#include "XorKernel.h"
+#include "HexCodec.h"
+#include "WorkerPool.h"
+#include "Log.h"
+#include "Stats.h"
+#include "Arena.h"
+#include "PatternTable.h"
+#include "Utf8.h"
 #include <fstream>
-#include <codecvt>
-#include <locale>
-#include <iostream>
 #include <algorithm>
 #include <filesystem>
 #include <iterator>
 #include <cstring>
+#include <cstdlib>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <climits>
-
-#ifdef __APPLE__
-#include <mach-o/dyld.h>
-#endif
-
-#ifdef __linux__
-#include <linux/limits.h>
-#endif
+#include <stdexcept>
+#include <random>
+#include <thread>
 
 using namespace std;
 namespace fs = std::filesystem;
 
 #define MUL_DIV_DATA_SIZE 40000
-Lockstitch* Lockstitch::instance = nullptr;
-
-// Helper function to convert wstring to string for Mac file operations
+// Files at least this large are encrypted/decrypted block by block instead of in memory
+#define STREAM_FILE_THRESHOLD (64 << 20)
+#define STREAM_BLOCK_SIZE (8 << 20)
+// Below this many bytes an XOR runs on the calling thread only
+#define PARALLEL_XOR_MIN (1 << 20)
+// Copying XOR works in pieces this size so each is XORed while still in L2
+#define XOR_COPY_BLOCK (64 << 10)
+// Strings per worker pool task in the batch text calls
+#define BATCH_MIN_CHUNK 64
+
+// Conversions at the edge of the wstring API; like the wstring_convert they replace, they throw range_error on malformed input
 static string wstring_to_string(const wstring& wstr) {
-    wstring_convert<codecvt_utf8<wchar_t>> converter;
-    return converter.to_bytes(wstr);
+    string str;
+    if (!Utf8::fromWide(wstr.data(), wstr.length(), str))
+        throw range_error("wstring_to_string: invalid code point");
+    return str;
 }
 
-// Helper function to convert string to wstring for Mac
 static wstring string_to_wstring(const string& str) {
-    wstring_convert<codecvt_utf8<wchar_t>> converter;
-    return converter.from_bytes(str);
+    wstring wstr;
+    if (!Utf8::toWide(str.data(), str.length(), wstr))
+        throw range_error("string_to_wstring: invalid UTF-8");
+    return wstr;
+}
+
+// Name decryptFile gives the plaintext: the .claudo extension swapped for the stored one
+static string decryptedPath(const string& filename, const string& extension) {
+    size_t lastDot = filename.rfind('.');
+    if (lastDot == string::npos)
+        lastDot = filename.length();
+    return filename.substr(0, lastDot) + '.' + extension;
+}
+
+// The wstring file calls return their paths wide and their errors as the _CN messages
+static wstring wideResult(const string& result) {
+    if (result == ERROR_FILE_IO_FAILURE)
+        return ERROR_FILE_IO_FAILURE_CN;
+    if (result == ERROR_PW_NOT_MATCH)
+        return ERROR_PW_NOT_MATCH_CN;
+    if (result == ERROR_DECRYPT_FAIL)
+        return ERROR_DECRYPT_FAIL_CN;
+    return string_to_wstring(result);
+}
+
+// Bytes up to the first NUL, which is where decrypted text ends
+static size_t textLength(const unsigned char* data, size_t n)
+{
+    const void* nul = n ? memchr(data, 0, n) : nullptr;
+    return nul ? (const unsigned char*)nul - data : n;
 }
 
-Lockstitch::Lockstitch()
+// Decimal digits of the table length, which is the width of the start location in every ciphertext
+static constexpr int decimalDigits(size_t n)
 {
-    char path[PATH_MAX];
-    string exePath = "";
+    return n < 10 ? 1 : 1 + decimalDigits(n / 10);
+}
 
-#ifdef __APPLE__
-    uint32_t size = PATH_MAX;
-    _NSGetExecutablePath(path, &size);
-    exePath = path;
-    int indx = exePath.find_last_of('/');
-    exePath = exePath.substr(0, indx + 1);
-#endif
+// Existing ciphertexts carry four-digit start locations
+static_assert(decimalDigits(PATTERN_TABLE_SIZE) == 4, "pattern table length changes the ciphertext format");
 
-    // Try to load from Resources in app bundle first
-    string codeFile = exePath + "../Resources/Code.txt";
-    ifstream ifs(codeFile);
-    
-    // If not found, try current directory
-    if (!ifs.good()) {
-        codeFile = exePath + "Code.txt";
-        ifs.open(codeFile);
-    }
-    
-    string content((istreambuf_iterator<char>(ifs)),
-        (istreambuf_iterator<char>()));
+Lockstitch::Lockstitch() : m_constantString(loadPatternTable()), m_preNumBufSize(decimalDigits(m_constantString.length())),
+    m_textKeys(makeKeySlices(TEXT_KEY_SIZE)), m_fileKeys(makeKeySlices(FILE_KEY_SIZE))
+{
+}
 
-    if (content != "")
+// The table is compiled in from cpp/code.txt; LOCKSTITCH_PATTERN_TABLE names a file to use instead
+string Lockstitch::loadPatternTable()
+{
+    const char* path = getenv("LOCKSTITCH_PATTERN_TABLE");
+    if (path && *path)
     {
-        m_constantString = content.c_str();
+        string content;
+        FileReader file(path);
+        if (file.isOpen())
+            file.readAll(content);
+
+        // Stops at the first NUL, like the embedded table; start positions need at least 12 bytes
+        content = content.c_str();
+        if (content.length() >= 12)
+            return content;
+
+        LOG_WARN("pattern table " << path << " is missing or too short, using the built-in one");
     }
-    else
-        m_constantString = "1bd4acef81b676f1bb87379ecad3e03ab937e8cca7fd6479d8cc1277ef68c2968c50ef933e45709fc7e98b3b43e69858fcfeffc870d0a5d01e50d4451019dc02b961fa5d512383b65eab63f9d2fb7ae6cdbe0137ea33aa028f9425471be7a5ed927e6b5ecd50684984d225445cdfbccce6d11ad9a2af05f394d368e80cabfe98661bea8dcd68ec3d32ba902bd0ab2ffd9e5ad7914bc085aafbfcba176d4011358c76aead51a45ca84ebaf7db296cb80ed0f988f01525c40ef186e1fc8f7048e96c9f3c1b55fbce946cc3267010f345fadafd37abe9e603e49f9d78aabebbf05d9b5446199dfce2cdf93d14ab61782bbd55702fe02db2980ff86b46ba691b29c1102fa71025a5a9eed8c98f0e55301388fe99bbdffa3542467dcd67c1814753338fc3d1a35025898100b753b2546f4ee9403548ed62a4de1277ef68c2968c50ef933e3b30bc3c57e8f60adf84f25ef2de3b48671a677072d32bd0d9612e519f52108f0e93d9a7a2e03aa13c4cc25f2bd2081b04a33762d7a6bf71a79d878c1a30e058215a52b44b8eb860a59eeb5a27e956f25ef332a5540258a97a2428645491f99a471412d0a693687fa7a2e09a16ceaa18e9d6808ef3375702df49d153cfb38d8f4c69aa25bf8313e8ddfc492fe99f2bc65a0722758f6f5ad4837bc26818bcd2b89d73b98fc6fa9bd5822dc7f55fde23642eb25c08248e2899ba23f8c999989b46dc70d4b5f5dbbe9365927b1d560d019d2030ef22758f6f5ad4837bc26818bcd2b89d79fc02955f7296fe67df4bc5e4f406bf56f25ef387096f7ad241c33bb6818a118faf98179fa5a62a348667a1b002508ecab12b1a98565dbc75f57512a8d3235b1fe37c51c804a00753ee0d2000263e04d35e00ae930156f25ef3db71d49b1ab12fb4d6c38a1617113a0860bb3f2300514e9d915f71fc27a2d8d452d23b77951d3b2b32fabf3ae51a88e95cd3645d01e6b78a102e497657986351fc220d83d38f923ded452646b64ef06447ba05fdb978dd04d21448bf56f25ef42fdc34822a50a5e30796772f14fdf179ae2b886351fc30df3b4af7e6317f818fea88f6a504d9ccf1ea9e6447ba017395f4a6dd65dd62d9b0317a9193feed32635b5b0f1ae3a307ae14bf7411c804a005095bef86c5a198cc5eacd9b1a67d093b137c51c804a007aa54871249c5c1a9e9d328ada74da971cc40542b03314f6aca059c64664b56f25ef484429edbab9008a717478a118faf98179fa5a62a348667a1b002508ecaad8c2cdffd05361a6e56a662727685d040b2399688137404fa53036f72965bfdd4e00b1430dc0e02a39c64677d7ed10977ecbf1d72927e2cfa4bf7768361032c8a76772d72972aebd5b2342f4c00d9cfa2f25ef4d8b0f39119d7e4abf33ffaf80a7afe2933d8b42590f9b99e52102100690cec227e5b9b6fada4b78a";
+
+    return string(PATTERN_TABLE, PATTERN_TABLE_SIZE);
 }
 
 // Implementation of all other methods from original Lockstitch.cpp
 // Copy-pasted with Mac-specific file handling modifications
 
-int Lockstitch::getPreNumBufSize()
+// One slice per start position, 0 to the table length inclusive, as m_constantString.substr(number, maxLen) gives
+vector<shared_ptr<const KeySlice>> Lockstitch::makeKeySlices(size_t maxLen) const
 {
-    int len = m_constantString.length();
-    int i = 0;
-    while (len > 0)
+    vector<shared_ptr<const KeySlice>> slices(m_constantString.length() + 1);
+    for (size_t number = 0; number < slices.size(); ++number)
     {
-        ++i;
-        len /= 10;
+        size_t size = min(maxLen, m_constantString.length() - number);
+        shared_ptr<KeySlice> key = make_shared<KeySlice>();
+        key->key = m_constantString.substr(number, size);
+        key->limbs = BigNum::fromBytes((const unsigned char*)key->key.data(), size);
+        BigNum::makeDivisor(key->limbs, key->divisor);
+        key->xorStream.resize(size + KEY_STREAM_PAD);
+        for (size_t i = 0; size && i < key->xorStream.size(); ++i)
+            key->xorStream[i] = key->key[i % size];
+        slices[number] = key;
     }
 
-    return i;
+    return slices;
 }
 
+const shared_ptr<const KeySlice>& Lockstitch::getKeySlice(int number, size_t maxLen) const
+{
+    // Same bounds behaviour as m_constantString.substr(number)
+    if ((size_t)number > m_constantString.length())
+        throw out_of_range("key start location past the pattern table");
+    if (maxLen == TEXT_KEY_SIZE)
+        return m_textKeys[number];
+    if (maxLen == FILE_KEY_SIZE)
+        return m_fileKeys[number];
+
+    throw invalid_argument("key slices are only built for the text and file key sizes");
+}
+
+// Built in place; start locations are a few characters, so these stay within the small-string buffer
 string Lockstitch::xorString(const char* const str1, const char* const str2, int len)const
 {
-    char* buf = new char[len + 1];
+    string str(len, '\0');
     int pLen = strlen(str1) - 1;
     for (int i = 0, j = 0; i < len; ++i, j = j == pLen ? 0 : j + 1)
-        buf[i] = str1[j] ^ str2[i];
-
-    buf[len] = 0;
-    string str(buf, len);  // Use length constructor to handle null bytes
-    delete[]buf;
+        str[i] = str1[j] ^ str2[i];
 
     return str;
 }
 
+// Stops at the first NUL, as the result always has
 wstring Lockstitch::xorString(const wchar_t* const str1, const wchar_t* const str2, int len)const
 {
-    wchar_t* buf = new wchar_t[len + 1];
+    wstring str(len, L'\0');
     int pLen = wcslen(str1) - 1;
     for (int i = 0, j = 0; i < len; ++i, j = j == pLen ? 0 : j + 1)
-        buf[i] = str1[j] ^ str2[i];
-
-    buf[len] = 0;
-    wstring str(buf);
-    delete[]buf;
+        str[i] = str1[j] ^ str2[i];
+    str.resize(wcslen(str.c_str()));
 
     return str;
 }
 
 string Lockstitch::xorString(const char* const str1, string& str2, int len)const
 {
-    char* buf = new char[len + 1];
-    int pLen = strlen(str1) - 1;
-    for (int i = 0, j = 0; i < len; ++i, j = j == pLen ? 0 : j + 1)
-        buf[i] = str1[j] ^ str2[i];
-
-    buf[len] = 0;
-    string str(buf, len);  // Use length constructor to handle null bytes
-    delete[]buf;
-
-    return str;
+    return xorString(str1, str2.data(), len);
 }
 
 wstring Lockstitch::xorString(const wchar_t* const str1, wstring& str2, int len)const
 {
-    wchar_t* buf = new wchar_t[len + 1];
-    int pLen = wcslen(str1)-1;
-    for (int i = 0, j = 0; i < len; ++i, j = j == pLen ? 0 : j + 1)
-        buf[i] = str1[j] ^ str2[i];
-
-    buf[len] = 0;
-    wstring str(buf);
-    delete[]buf;
-
-    return str;
+    return xorString(str1, str2.data(), len);
 }
 
 void Lockstitch::xorString(vector<unsigned char>& str1, const string str2)
@@ -159,289 +198,163 @@ void Lockstitch::xorString(vector<unsigned char>& str1, const string str2)
     }
 }
 
-// Continue with rest of implementation - mulString, divString, etc.
-// [I'll include the key functions needed for file encryption]
-
-vector<unsigned char> Lockstitch::mulString(vector<unsigned char>& str1, string str2)
+void Lockstitch::xorString(vector<unsigned char>& str1, const KeySlice& key)
 {
-    vector<unsigned char>destStr;
-    int n1 = str1.size() * 8;
-    int n2 = str2.length() * 8;
-    int n = n1 + n2;
-    if (n == 0)
-        return destStr;
-
-    unsigned char* V1 = new unsigned char[n1];
-    unsigned char* V2 = new unsigned char[n2];
-    unsigned char* V = new unsigned char[n];
-    for (int j = 0, i = str1.size() - 1; i >= 0; i--)
-    {
-        int c = str1[i];
-        int mask = 0x1;
-        for (int k = 0; k < 8; k++)
-        {
-            V1[j++] = c & mask ? 1 : 0;
-            mask <<= 1;
-        }
-    }
+    xorString(str1.data(), str1.size(), key, 0);
+}
 
-    for (int j = 0, i = str2.length() - 1; i >= 0; i--)
-    {
-        int c = str2[i];
-        int mask = 0x1;
-        for (int k = 0; k < 8; k++)
-        {
-            V2[j++] = c & mask ? 1 : 0;
-            mask <<= 1;
-        }
-    }
+// XOR n bytes that sit at position offset of the key-repeating stream
+void Lockstitch::xorString(unsigned char* p, size_t n, const KeySlice& key, size_t offset)
+{
+    xorString(p, p, n, key, offset);
+}
 
-    memset(V, 0, n);
-    int overflow, bit1, bit2, temp;
-    for (int i = 0; i < n2; i++)
+// Same, reading from src and writing to dst
+void Lockstitch::xorString(const unsigned char* src, unsigned char* dst, size_t n, const KeySlice& key, size_t offset)
+{
+    PhaseTimer timer(STAT_XOR, n);
+    size_t len = key.key.length();
+    if (len == 0 || n == 0)
     {
-        overflow = 0;
-        if (V2[i] == 1)
-        {
-            for (int j = 0; j < n1; j++)
-            {
-                bit1 = V1[j];
-                bit2 = V[i + j];
-                temp = bit1 + bit2 + overflow;
-                if ((temp & 1) == 1)
-                    V[i + j] = 1;
-                else
-                    V[i + j] = 0;
-                overflow = (temp >> 1);
-            }
-            if (overflow == 1)
-                V[i + n1] = 1;
-        }
+        if (src != dst && n)
+            memcpy(dst, src, n);
+        return;
     }
 
-    int N = n / 8;
-    int mask = 0x80;
-    for (int c = 0, j = 0, k = 0, i = n - 1; i >= 0; i--)
-    {
-        if (V[i])
-            c += mask;
-        mask >>= 1;
-        j++;
-        if (j == 8)
+    offset %= len;
+    const unsigned char* stream = key.xorStream.data();
+    auto run = [&](size_t begin, size_t end) {
+        if (src == dst)
         {
-            destStr.push_back(c);
-            c = 0;
-            j = 0;
-            mask = 0x80;
+            XorKernel::apply(dst + begin, end - begin, stream, len, offset);
+            return;
         }
-    }
-
-    delete[]V1;
-    delete[]V2;
-    delete[]V;
-
-    return destStr;
-}
-
-vector<unsigned char> Lockstitch::divString(vector<unsigned char>& str1, string str2)
-{
-    vector<unsigned char> output;
-
-    int n1 = str1.size() * 4;
-    int n2 = str2.length() * 8;
-    int n = n1 - n2 + 1;
-    if (n1 == 0 || n2 == 0 || n1 < n2)
-        return output;
-
-    unsigned char* V1 = new unsigned char[n1];
-    unsigned char* V2 = new unsigned char[n2];
-    unsigned char* V = new unsigned char[n];
-
-    for (int i = 0, j = n1 - 1; i < str1.size(); i++)
-    {
-        int c = 0;
-        if ((str1[i] >= '0') && (str1[i] <= '9'))
-            c = str1[i] - '0';
-        else if ((str1[i] >= 'a') && (str1[i] <= 'f'))
-            c = str1[i] - 'a' + 10;
-        int mask = 0x8;
-        for (int k = 0; k < 4; k++)
+        for (size_t pos = begin; pos < end; pos += XOR_COPY_BLOCK)
         {
-            if (c & mask)
-                V1[j] = 1;
-            else
-                V1[j] = 0;
-            mask = mask >> 1;
-            j--;
+            size_t m = min(end - pos, (size_t)XOR_COPY_BLOCK);
+            memcpy(dst + pos, src + pos, m);
+            XorKernel::apply(dst + pos, m, stream, len, (offset + pos) % len);
         }
-    }
+    };
 
-    for (int j = 0, i = str2.length() - 1; i >= 0; i--)
+    // Only inputs well past SMALL_JOB_BYTES split, so they always belong to the file lane
+    WorkerPool& pool = WorkerPool::forLane(LANE_FILE);
+    if (n < PARALLEL_XOR_MIN || pool.threadCount() < 2)
     {
-        int c = str2[i];
-        int mask = 0x1;
-        for (int k = 0; k < 8; k++)
-        {
-            V2[j++] = c & mask ? 1 : 0;
-            mask <<= 1;
-        }
+        run(0, n);
+        return;
     }
 
-    memset(V, 0, n);
-
-    while ((n1 > 0) && (V1[n1 - 1] == 0))
-        n1--;
+    // Ranges start on multiples of the key length, so each one begins at the same key offset
+    pool.parallelFor(n, len, PARALLEL_XOR_MIN / 4, run);
+}
 
-    while ((n2 > 0) && (V2[n2 - 1] == 0))
-        n2--;
+// Continue with rest of implementation - mulString, divString, etc.
+// [I'll include the key functions needed for file encryption]
 
-    if ((n1 == 0) || (n2 == 0))
-    {
-        delete[]V1;
-        delete[]V2;
-        delete[]V;
+vector<unsigned char> Lockstitch::mulString(vector<unsigned char>& str1, string str2)
+{
+    KeySlice key;
+    key.key = str2;
+    key.limbs = BigNum::fromBytes((const unsigned char*)str2.data(), str2.length());
 
-        return output;
-    }
+    return mulString(str1, key);
+}
 
-    int overflow, bit1, bit2, temp;
-    n = n1 - n2 + 1;
-    int i = n1 - n2;
-    while (i >= 0)
-    {
-        bool bLarge = true;
-        if ((n1 - i) < n2)
-            bLarge = false;
-        else if ((n1 - i) == n2)
-        {
-            for (int j = n2 - 1; j >= 0; j--)
-            {
-                if (V1[i + j] > V2[j])
-                {
-                    bLarge = true;
-                    break;
-                }
-                if (V1[i + j] < V2[j])
-                {
-                    bLarge = false;
-                    break;
-                }
-            }
-        }
-        else
-            bLarge = true;
+vector<unsigned char> Lockstitch::mulString(vector<unsigned char>& str1, const KeySlice& key)
+{
+    vector<unsigned char> destStr(str1.size() + key.key.length());
+    mulBytes(str1.data(), str1.size(), key, destStr.data());
 
-        if (bLarge)
-        {
-            V[i] = 1;
-            overflow = 0;
-            for (int j = 0; j < n2; j++)
-            {
-                bit1 = 0;
-                if (((i + j) < n1) && (V1[i + j] == 1))
-                    bit1 = 1;
-                if (V2[j] == 1)
-                    bit2 = 1;
-                else
-                    bit2 = 0;
-                temp = bit1 - bit2 - overflow;
-                if (temp == 0)
-                {
-                    overflow = 0;
-                    V1[i + j] = 0;
-                }
-                else if (temp == 1)
-                {
-                    overflow = 0;
-                    V1[i + j] = 1;
-                }
-                else if (temp == -1)
-                {
-                    overflow = 1;
-                    V1[i + j] = 1;
-                }
-                else if (temp == -2)
-                {
-                    overflow = 1;
-                    V1[i + j] = 0;
-                }
-                else
-                    throw ("Error");
-            }
+    return destStr;
+}
 
-            if (overflow == 1)
-                V1[n1 - 1] = 0;
+// size + key length bytes of product into out; both operands are big-endian and the product
+// keeps that full width
+void Lockstitch::mulBytes(const unsigned char* data, size_t size, const KeySlice& key, unsigned char* out)
+{
+    PhaseTimer timer(STAT_MULDIV, size);
+    ArenaScope scope;
+    size_t an = (size + 7) / 8;
+    size_t bn = key.limbs.size();
+    limb_t* a = scope.alloc<limb_t>(an);
+    limb_t* r = scope.alloc<limb_t>(an + bn);
+
+    BigNum::fromBytes(data, size, a);
+    BigNum::mul(a, an, key.limbs.data(), bn, r);
+    BigNum::toBytes(r, an + bn, out, size + key.key.length());
+}
 
-            int j = n1 - 1;
-            while (j >= 0)
-            {
-                if (V1[j] == 1)
-                    break;
-                j--;
-            }
-            n1 = j + 1;
-        }
-        else
-        {
-            V[i] = 0;
-        }
-        i--;
-    }
+vector<unsigned char> Lockstitch::divString(vector<unsigned char>& str1, string str2)
+{
+    KeySlice key;
+    key.key = str2;
+    key.limbs = BigNum::fromBytes((const unsigned char*)str2.data(), str2.length());
+    BigNum::makeDivisor(key.limbs, key.divisor);
 
-    if (V[n - 1] == 0)
-        n--;
+    return divString(str1, key);
+}
 
-    int N = (n + 7) / 8;
-    output.resize(N);
-    int j = N - 1;
-    int k = 0;
-    int mask = 0x1;
-    int c = 0;
-    for (i = 0; i < n; i++)
-    {
-        if (V[i] == 1)
-            c = c + mask;
-        mask = mask << 1;
-        k++;
-        if (k == 8)
-        {
-            output[j--] = c;
-            mask = 0x1;
-            k = 0;
-            c = 0;
-        }
-    }
-    if (k != 0)
-        output[j] = c;
+vector<unsigned char> Lockstitch::divString(vector<unsigned char>& str1, const KeySlice& key)
+{
+    ArenaScope scope;
+    unsigned char* quotient;
+    size_t n = divHex(str1.data(), str1.size(), key, scope, quotient);
 
-    delete[]V1;
-    delete[]V2;
-    delete[]V;
+    return vector<unsigned char>(quotient, quotient + n);
+}
 
-    return output;
+// Quotient of len hex digits by the key, as big-endian bytes without leading zeros, allocated
+// from scope; returns its length (0 for a zero quotient or a dividend shorter than the key)
+size_t Lockstitch::divHex(const unsigned char* hex, size_t len, const KeySlice& key, ArenaScope& scope, unsigned char*& out)
+{
+    PhaseTimer timer(STAT_MULDIV, len);
+    out = nullptr;
+
+    // hex holds 4 bits per digit, the key 8 bits per byte
+    size_t n1 = len * 4;
+    size_t n2 = key.key.length() * 8;
+    if (n1 == 0 || n2 == 0 || n1 < n2 || key.divisor.norm.empty())
+        return 0;
+
+    size_t an = (len + 15) / 16;
+    limb_t* a = scope.alloc<limb_t>(an);
+    limb_t* q = scope.alloc<limb_t>(an);
+    if (!BigNum::fromHex(hex, len, a))
+        LOG_DEBUG("divString: input has non-hex characters, read as zero");
+    size_t qn = BigNum::div(a, an, key.divisor, q);
+
+    size_t n = BigNum::byteLength(q, qn);
+    out = scope.alloc<unsigned char>(n);
+    BigNum::toBytes(q, qn, out, n);
+
+    return n;
 }
 
 // String encryption methods
+// The result is the only heap allocation; the product lives in the thread's arena
 string Lockstitch::encrypt(string& content)
 {
-    int number = getEncodePaterStartPos();
-    string str1 = to_string(number);
-    int bufSize = getPreNumBufSize();
-    int dif = bufSize - str1.length();
-    while (dif-- > 0)
-        str1 = "0" + str1;
+    return encryptAt(content, getEncodePaterStartPos());
+}
 
-    string str2 = m_constantString.substr(number);
-    str2 = str2.substr(0, 10);
+string Lockstitch::encryptAt(const string& content, int number)
+{
+    int bufSize = getPreNumBufSize();
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, TEXT_KEY_SIZE);
 
-    vector<unsigned char> contentV = stringToCharList(content);
-    vector<unsigned char> str3V = mulString(contentV, str2);
+    ArenaScope scope;
+    size_t n = content.length() + key->key.length();
+    unsigned char* product = scope.alloc<unsigned char>(n);
+    mulBytes((const unsigned char*)content.data(), content.length(), *key, product);
 
-    str1 = xorString(prefixData, str1, bufSize);
-    string encryptedContent = charListToHexString(str3V);
-    string str(encryptedContent.begin(), encryptedContent.end());
+    // Start location, then the product as hex
+    string str = getStartLocation(number);
+    str.resize(bufSize + 2 * n);
+    PhaseTimer timer(STAT_HEX, n);
+    HexCodec::encode(product, n, (unsigned char*)&str[bufSize]);
 
-    return str1 + str;
+    return str;
 }
 
 wstring Lockstitch::encrypt(wstring& content)
@@ -453,11 +366,10 @@ wstring Lockstitch::encrypt(wstring& content)
     while (dif-- > 0)
         str1 = L"0" + str1;
 
-    string str2 = m_constantString.substr(number);
-    str2 = str2.substr(0, 10);
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, TEXT_KEY_SIZE);
 
     vector<unsigned char> contentV = wstringToCharList(content);
-    vector<unsigned char> str3V = mulString(contentV, str2);
+    vector<unsigned char> str3V = mulString(contentV, *key);
 
     str1 = xorString(prefixData_t, str1, bufSize);
     string encryptedContent = charListToHexString(str3V);
@@ -477,20 +389,23 @@ string Lockstitch::decrypt(string& content)
     try {
         number = stoi(str1);
     }
-    catch (invalid_argument& ex) {
+    catch (const invalid_argument&) {
         return "Invalid input. The content is not valid encrypted data.";
     }
-    catch (out_of_range& ex) {
+    catch (const out_of_range&) {
         return "Invalid input. The content format is incorrect.";
     }
+    if (number <= 0 || (size_t)number + TEXT_KEY_SIZE > m_constantString.length())
+        return "Invalid input. The content format is incorrect.";
     
-    string str2 = content.substr(len);
-    string str3 = m_constantString.substr(number);
-    str3 = str3.substr(0, 10);
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, TEXT_KEY_SIZE);
 
-    vector<unsigned char>data(str2.begin(), str2.end());
-    vector<unsigned char> output = divString(data, str3.c_str());
-    return charListToString(output);
+    // The hex digits are read in place and the quotient lives in the thread's arena
+    ArenaScope scope;
+    unsigned char* output;
+    size_t n = divHex((const unsigned char*)content.data() + len, content.length() - len, *key, scope, output);
+
+    return string((const char*)output, textLength(output, n));
 }
 
 wstring Lockstitch::decrypt(wstring& content)
@@ -504,18 +419,47 @@ wstring Lockstitch::decrypt(wstring& content)
     try {
         number = stoi(str1);
     }
-    catch (invalid_argument ex) {
+    catch (const invalid_argument&) {
+        return L"Invalid input. The input content is not valid Claudo encrypted data";
+    }
+    catch (const out_of_range&) {
         return L"Invalid input. The input content is not valid Claudo encrypted data";
     }
+    if (number <= 0 || (size_t)number + TEXT_KEY_SIZE > m_constantString.length())
+        return L"Invalid input. The input content is not valid Claudo encrypted data";
     wstring str2 = content.substr(len);
-    string str3 = m_constantString.substr(number);
-    str3 = str3.substr(0, 10);
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, TEXT_KEY_SIZE);
 
     vector<unsigned char>data(str2.begin(), str2.end());
-    vector<unsigned char> output = divString(data, str3.c_str());
+    vector<unsigned char> output = divString(data, *key);
     return charListToWString(output);
 }
 
+// Each string gets its own start position, exactly as encrypt() would give it; the key slices
+// are shared through the cache and the strings are spread over the text lane's worker pool
+vector<string> Lockstitch::encryptStrings(vector<string>& contents)
+{
+    vector<string> results(contents.size());
+    WorkerPool::forLane(LANE_TEXT).parallelFor(contents.size(), 1, BATCH_MIN_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            results[i] = encrypt(contents[i]);
+    });
+
+    return results;
+}
+
+// Invalid entries come back as the same "Invalid input." messages decrypt() returns
+vector<string> Lockstitch::decryptStrings(vector<string>& contents)
+{
+    vector<string> results(contents.size());
+    WorkerPool::forLane(LANE_TEXT).parallelFor(contents.size(), 1, BATCH_MIN_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            results[i] = decrypt(contents[i]);
+    });
+
+    return results;
+}
+
 // Helper methods
 vector<unsigned char> Lockstitch::stringToCharList(string& str)
 {
@@ -526,74 +470,80 @@ vector<unsigned char> Lockstitch::stringToCharList(string& str)
     return v;
 }
 
+// The wide text API works on UTF-16LE bytes whatever the width of wchar_t, so its output is the same everywhere
 vector<unsigned char> Lockstitch::wstringToCharList(wstring& wstr)
 {
-    const size_t newsizew = wstr.length() * 2;
-    vector<unsigned char> v(newsizew);
-    memcpy(v.data(), wstr.c_str(), newsizew);
+    vector<unsigned char> v;
+    v.reserve(wstr.length() * 2);
+    for (wchar_t wc : wstr)
+    {
+        uint32_t c = (uint32_t)wc;
+        if (sizeof(wchar_t) > 2 && c >= 0x10000 && c <= 0x10FFFF)
+        {
+            c -= 0x10000;
+            uint32_t high = 0xD800 + (c >> 10), low = 0xDC00 + (c & 0x3FF);
+            v.insert(v.end(), { (unsigned char)high, (unsigned char)(high >> 8), (unsigned char)low, (unsigned char)(low >> 8) });
+        }
+        else
+            v.insert(v.end(), { (unsigned char)c, (unsigned char)(c >> 8) });
+    }
 
     return v;
 }
 
 string Lockstitch::charListToString(vector<unsigned char>& v)
 {
-    size_t n = v.size() + 1;
-    char* data = new char[n];
-    memcpy(data, v.data(), n);
-    data[n - 1] = 0;
-    string str(data);
-    delete[]data;
-
-    return str;
+    return string((const char*)v.data(), textLength(v.data(), v.size()));
 }
 
+// UTF-16LE up to the first NUL unit; an odd last byte is dropped
 wstring Lockstitch::charListToWString(vector<unsigned char>& v)
 {
-    size_t n = (v.size() >> 1) + 1;
-    wchar_t* data = new wchar_t[n];
-    memcpy(data, v.data(), v.size());
-    data[n - 1] = 0;
-    wstring wstr(data);
-    delete[]data;
+    wstring wstr;
+    wstr.reserve(v.size() >> 1);
+    for (size_t i = 0; i + 1 < v.size(); i += 2)
+    {
+        uint32_t c = v[i] | (v[i + 1] << 8);
+        if (c == 0)
+            break;
+        if (sizeof(wchar_t) > 2 && c >= 0xD800 && c <= 0xDBFF && i + 3 < v.size())
+        {
+            uint32_t low = v[i + 2] | (v[i + 3] << 8);
+            if (low >= 0xDC00 && low <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        wstr.push_back((wchar_t)c);
+    }
 
     return wstr;
 }
 
 string Lockstitch::charListToHexString(vector<unsigned char>& arr)
 {
-    char const hex[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
-    string str;
-    for (int i = 0; i < arr.size(); ++i) {
-        const unsigned char ch = arr[i];
-        str += hex[(ch & 0xF0) >> 4];
-        str += hex[ch & 0xF];
-    }
+    PhaseTimer timer(STAT_HEX, arr.size());
+    string str(arr.size() * 2, '\0');
+    HexCodec::encode(arr.data(), arr.size(), (unsigned char*)&str[0]);
 
     return str;
 }
 
 vector<unsigned char> Lockstitch::charListToHexCharArray(vector<unsigned char>& arr)
 {
-    char const hex[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
-    vector<unsigned char> str;
-    for (int i = 0; i < arr.size(); ++i) {
-        const unsigned char ch = arr[i];
-        str.push_back(hex[(ch & 0xF0) >> 4]);
-        str.push_back(hex[ch & 0xF]);
-    }
+    PhaseTimer timer(STAT_HEX, arr.size());
+    vector<unsigned char> str(arr.size() * 2);
+    HexCodec::encode(arr.data(), arr.size(), str.data());
 
     return str;
 }
 
 string Lockstitch::loadTxtFile(string strFilePath)
 {
-    std::ifstream file(strFilePath);
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    std::string buffer(size, ' ');
-    file.seekg(0);
-    file.read(&buffer[0], size);
-    file.close();
+    std::string buffer;
+    FileReader file(strFilePath);
+    file.readAll(buffer);
 
     return buffer;
 }
@@ -602,398 +552,775 @@ string Lockstitch::loadTxtFile(string strFilePath)
 wstring Lockstitch::loadTxtFile(wstring strFilePath)
 {
     string utf8_path = wstring_to_string(strFilePath);
-    ifstream file(utf8_path, ios::binary);
+    FileReader file(utf8_path);
     
-    if (!file.good())
+    if (!file.isOpen())
         return L"Error. Failed to open file - " + strFilePath;
 
-    file.seekg(0, ios::end);
-    size_t size = file.tellg();
-    file.seekg(0);
-    
-    string content(size, '\0');
-    file.read(&content[0], size);
-    file.close();
-    
-    // Convert UTF-8 to wstring
-    wstring_convert<codecvt_utf8<wchar_t>> converter;
-    try {
-        return converter.from_bytes(content);
-    } catch (...) {
+    string content;
+    file.readAll(content);
+
+    wstring wcontent;
+    if (!Utf8::toWide(content.data(), content.length(), wcontent))
         return L"Error reading file content";
-    }
+
+    return wcontent;
 }
 
-vector<unsigned char> Lockstitch::loadFile(ifstream& file)
+vector<unsigned char> Lockstitch::loadFile(const FileReader& file)
 {
-    file.unsetf(ios::skipws);
-
-    streampos file_size;
-    file.seekg(0, ios::end);
-    file_size = file.tellg();
-    file.seekg(0, ios::beg);
-
+    PhaseTimer timer(STAT_LOAD);
     vector<unsigned char> vec;
-    vec.reserve(file_size);
-    vec.insert(vec.begin(),
-        istream_iterator<unsigned char>(file),
-        istream_iterator<unsigned char>());
-
-    file.close();
+    file.readAll(vec);
+    timer.setBytes(vec.size());
 
     return vec;
 }
 
-// File encryption methods - Mac compatible
+// File encryption methods - Mac compatible. Paths and passwords are UTF-8 and used as they are.
 string Lockstitch::encryptFile(string filename, string pw, int headSize)
 {
-    wstring wfilename = string_to_wstring(filename);
-    wstring wpw = string_to_wstring(pw);
-    wstring retVal = encryptFile(wfilename, wpw, headSize);
-    if (retVal == ERROR_FILE_IO_FAILURE_CN)
+    FileReader file(filename);
+    if (!file.isOpen())
         return ERROR_FILE_IO_FAILURE;
 
-    string retFile(retVal.begin(), retVal.end());
-    
-    return std::move(retFile);
+    size_t fileSize = file.size();
+    int indx = filename.find_last_of('.');
+    if (indx == string::npos)
+        indx = filename.length();
+
+    string ext = filename.substr(indx + 1);
+    string outFilePath = filename.substr(0, indx) + ".claudo";
+
+    // Large files are streamed straight into the output, unless that would overwrite the input
+    bool streaming = fileSize >= STREAM_FILE_THRESHOLD && outFilePath != filename;
+    string trailer = makeTrailer(ext, pw);
+    vector<unsigned char> vec;
+    SegmentList segments;
+    string startLocation;
+    if (!streaming)
+    {
+        vec = loadFile(file);
+        startLocation = encryptData(vec.data(), vec.size(), segments, ext, headSize);
+        segments.add((const unsigned char*)startLocation.data(), startLocation.length());
+        segments.add((const unsigned char*)trailer.data(), trailer.length());
+    }
+
+    // The output is allocated at its final size and written at known offsets
+    FileWriter out(outFilePath);
+    bool ok = streaming ? encryptStream(file, out, fileSize, ext, headSize, trailer)
+        : out.allocate(segments.total) && writeSegments(segments, out, 0);
+    if (!out.close() || !ok)
+    {
+        remove(outFilePath.c_str());
+        return ERROR_FILE_IO_FAILURE;
+    }
+
+    return outFilePath;
 }
 
 wstring Lockstitch::encryptFile(wstring filename, wstring pw, int headSize)
 {
-    // Convert wstring to string for Mac file operations
-    string utf8_filename = wstring_to_string(filename);
-    ifstream file(utf8_filename, std::ios::binary);
-    if (file.fail())
-        return ERROR_FILE_IO_FAILURE_CN;
-
-    vector<unsigned char> vec = loadFile(file);
-    int indx = filename.find_last_of('.');
-    if (indx == string::npos)
-        indx = filename.length();
+    return wideResult(encryptFile(wstring_to_string(filename), wstring_to_string(pw), headSize));
+}
 
-    wstring extension = filename.substr(indx + 1);
-    string ext(extension.begin(), extension.end());
-    string startLocation = encryptData(vec, ext, headSize);
-    
-    // Convert extension to UTF-8 for cross-platform storage (16 bytes)
-    string ext_utf8 = wstring_to_string(extension);
+// Extension (16 bytes) then password (32 bytes), both space-padded UTF-8 XORed with prefixData
+string Lockstitch::makeTrailer(string ext_utf8, string pw_utf8)
+{
     while (ext_utf8.length() < 16)
         ext_utf8 += ' ';
     ext_utf8 = ext_utf8.substr(0, 16);
     string extension_encrypted = xorString(prefixData, (char*)ext_utf8.c_str(), 16);
-    if (pw.length() < 16)
-        pw.resize(16, ' ');
 
-    
-    // Convert password to UTF-8 for cross-platform storage (32 bytes)
-    string pw_utf8 = wstring_to_string(pw);
-    cout << "DEBUG encrypt: input password wstring length=" << pw.length() << endl;
-    cout << "DEBUG encrypt: pw_utf8 before padding='" << pw_utf8 << "' (len=" << pw_utf8.length() << ")" << endl;
-    
-    // Print password bytes before padding
-    cout << "DEBUG encrypt: pw_utf8 bytes before padding (hex): ";
-    for (size_t i = 0; i < pw_utf8.length(); i++) {
-        cout << std::hex << (int)(unsigned char)pw_utf8[i] << " ";
-    }
-    cout << std::dec << endl;
-    
+    // The password is first padded to 16 characters, not bytes, then to 32 bytes
+    size_t chars = Utf8::length(pw_utf8.data(), pw_utf8.length());
+    if (chars < 16)
+        pw_utf8.append(16 - chars, ' ');
     if (pw_utf8.length() < 32)
         pw_utf8.resize(32, ' ');
     pw_utf8 = pw_utf8.substr(0, 32);
-    cout << "DEBUG encrypt: pw_utf8 after padding (len=" << pw_utf8.length() << ")" << endl;
-    
-    // Print password bytes after padding
-    cout << "DEBUG encrypt: pw_utf8 bytes after padding (hex): ";
-    for (size_t i = 0; i < pw_utf8.length(); i++) {
-        cout << std::hex << (int)(unsigned char)pw_utf8[i] << " ";
-    }
-    cout << std::dec << endl;
-    cout.flush();
-    
     string password_encrypted = xorString(prefixData, (char*)pw_utf8.c_str(), 32);
+
+    return extension_encrypted + password_encrypted;
+}
+
+// Checks pw against a trailer written by makeTrailer and recovers the stored extension
+bool Lockstitch::readTrailer(const char* trailer, const string& pw, string& extension_utf8)
+{
+    char arr[32];
+    copy(trailer + 16, trailer + 48, arr);
+
+    // Read password as UTF-8 bytes (32 bytes); both sides are compared as bytes
+    string password = xorString(prefixData, arr, 32);
+
+    // Trim trailing spaces from stored password
+    size_t end = password.find_last_not_of(' ');
+    if (end != string::npos)
+        password.resize(end + 1);
+    
+    // Trim trailing spaces from input password
+    size_t pwLength = pw.length();
+    end = pw.find_last_not_of(' ');
+    if (end != string::npos)
+        pwLength = end + 1;
     
-    // Print encrypted password bytes
-    cout << "DEBUG encrypt: password_encrypted bytes (hex): ";
-    for (size_t i = 0; i < password_encrypted.length(); i++) {
-        cout << std::hex << (int)(unsigned char)password_encrypted[i] << " ";
+    if (password.compare(0, string::npos, pw, 0, pwLength) != 0) {
+        LOG_DEBUG("readTrailer: password mismatch");
+        return false;
     }
-    cout << std::dec << endl;
-    cout.flush();
 
-    filename = filename.substr(0, indx) + L".claudo";
-    string output_filename = wstring_to_string(filename);
-    ofstream fs(output_filename, ios::out | ios::binary | ios::trunc);
-    fs.write((char*)vec.data(), vec.size());
-    fs.write(startLocation.c_str(), startLocation.length());
-    fs.write(extension_encrypted.c_str(), 16);
-    fs.write(password_encrypted.c_str(), 32);
-    fs.close();
+    copy(trailer, trailer + 16, arr);
+    
+    // Read extension as UTF-8 bytes (16 bytes)
+    extension_utf8 = xorString(prefixData, arr, 16);
+    
+    // Trim trailing spaces
+    size_t ext_end = extension_utf8.find_last_not_of(' ');
+    if (ext_end != string::npos)
+        extension_utf8 = extension_utf8.substr(0, ext_end + 1);
+    
+    LOG_DEBUG("readTrailer: extension '" << extension_utf8 << "'");
 
-    return filename;
+    return true;
 }
 
 string Lockstitch::decryptFile(string filename, string pw)
 {
-    wstring wfilename = string_to_wstring(filename);
-    wstring wpw = string_to_wstring(pw);
-    wstring retVal = decryptFile(wfilename, wpw);
-    if (retVal == ERROR_FILE_IO_FAILURE_CN)
-        return ERROR_FILE_IO_FAILURE;
+    try {
+        FileReader file(filename);
+        if (!file.isOpen())
+            return ERROR_FILE_IO_FAILURE;
+
+        // Password and layout are checked from the end of the file before any of it is loaded
+        string extension_utf8;
+        ClaudoLayout layout;
+        string error = checkFile(file, pw, extension_utf8, layout);
+        if (!error.empty())
+            return error;
+
+        // Large files are streamed, unless the output would overwrite the input
+        size_t fileSize = file.size();
+        string outFilePath = decryptedPath(filename, extension_utf8);
+        if (fileSize >= STREAM_FILE_THRESHOLD && outFilePath != filename)
+        {
+            // decryptStream fails only on a read or write, and throws if the prefix does not divide;
+            // either way the truncated output is removed, as on the in-memory path
+            FileWriter out(outFilePath);
+            bool ok;
+            try {
+                ok = decryptStream(file, layout, out) == 0;
+            }
+            catch (const exception& e) {
+                out.close();
+                remove(outFilePath.c_str());
+                return ERROR_DECRYPT_FAIL;
+            }
+            if (!out.close() || !ok) {
+                remove(outFilePath.c_str());
+                return ERROR_FILE_IO_FAILURE;
+            }
 
-    if (retVal == ERROR_PW_NOT_MATCH_CN)
-        return ERROR_PW_NOT_MATCH;
+            return outFilePath;
+        }
 
-    if (retVal == ERROR_DECRYPT_FAIL_CN)
-        return ERROR_DECRYPT_FAIL;
+        vector<unsigned char> content = loadFile(file);
+        if (content.size() != fileSize)
+            return ERROR_FILE_IO_FAILURE;
+
+        SegmentList segments;
+        if (decryptData(content.data(), content.size() - 48, segments, extension_utf8) == 1)
+            return ERROR_DECRYPT_FAIL;
+
+        FileWriter out(outFilePath);
+        bool ok = out.allocate(segments.total) && writeSegments(segments, out, 0);
+        if (!out.close() || !ok) {
+            remove(outFilePath.c_str());
+            return ERROR_FILE_IO_FAILURE;
+        }
 
-    if (retVal == ERROR_FILE_IO_FAILURE_CN)
+        return outFilePath;
+    }
+    catch (const ios_base::failure& e) {
         return ERROR_FILE_IO_FAILURE;
+    }
+    catch (const exception& e) {
+        return ERROR_DECRYPT_FAIL;
+    }
+
+    return ERROR_DECRYPT_FAIL;
+}
+
+string Lockstitch::inspectFile(string fileName, string pw, ClaudoInfo& info)
+{
+    info = ClaudoInfo();
+    try {
+        FileReader file(fileName);
+        if (!file.isOpen())
+            return ERROR_FILE_IO_FAILURE;
+
+        string error = checkFile(file, pw, info.extension, info.layout);
+        if (!error.empty())
+            return error;
 
-    string retFile(retVal.begin(), retVal.end());
+        info.fileSize = file.size();
+        info.outputPath = decryptedPath(fileName, info.extension);
+    }
+    catch (const exception& e) {
+        return ERROR_DECRYPT_FAIL;
+    }
 
-    return std::move(retFile);
+    return "";
 }
 
 wstring Lockstitch::decryptFile(wstring filename, wstring pw)
 {
-    cout << "DEBUG: decryptFile called" << endl;
-    cout.flush();
     try {
-        string utf8_filename = wstring_to_string(filename);
-        ifstream file(utf8_filename, ios::binary);
-        if (file.fail())
-            return ERROR_FILE_IO_FAILURE_CN;
+        return wideResult(decryptFile(wstring_to_string(filename), wstring_to_string(pw)));
+    }
+    catch (const exception& e) {
+        return ERROR_DECRYPT_FAIL_CN;
+    }
+}
 
-        vector<unsigned char> content = loadFile(file);
-        cout << "DEBUG: File loaded, size=" << content.size() << endl;
-        cout.flush();
-        
-        if (content.size() < 48) {
-            cout << "DEBUG: File too small (need at least 48 bytes for password+extension)" << endl;
-            cout.flush();
-            return ERROR_DECRYPT_FAIL_CN;
-        }
-        
-        char arr[32];
-        cout << "DEBUG: About to copy last 32 bytes for password" << endl;
-        cout.flush();
-        copy(content.end() - 32, content.end(), arr);
-        content.erase(content.end() - 32, content.end());
-        
-        cout << "DEBUG: About to xorString for password" << endl;
-        cout.flush();
-        // Read password as UTF-8 bytes (32 bytes)
-        string password_utf8 = xorString(prefixData, arr, 32);
-        cout << "DEBUG: xorString done, password_utf8.length()=" << password_utf8.length() << endl;
-        cout.flush();
-        
-        // Print password bytes safely
-        cout << "DEBUG: password_utf8 bytes (hex): ";
-        for (size_t i = 0; i < password_utf8.length() && i < 32; i++) {
-            cout << std::hex << (int)(unsigned char)password_utf8[i] << " ";
-        }
-        cout << std::dec << endl;
-        cout.flush();
-        
-        cout << "DEBUG: About to convert password to wstring" << endl;
-        cout.flush();
-        wstring password = string_to_wstring(password_utf8);
-        
-        cout << "DEBUG decrypt: stored password_utf8='" << password_utf8 << "' (len=" << password_utf8.length() << ")" << endl;
-        cout << "DEBUG decrypt: input pw wstring length=" << pw.length() << endl;
-        cout.flush();
-        
-        // Trim trailing spaces from stored password
-        size_t end = password.find_last_not_of(L' ');
-        if (end != wstring::npos)
-            password = password.substr(0, end + 1);
-        
-        // Trim trailing spaces from input password
-        wstring pw_trimmed = pw;
-        end = pw_trimmed.find_last_not_of(L' ');
-        if (end != wstring::npos)
-            pw_trimmed = pw_trimmed.substr(0, end + 1);
-        
-        cout << "DEBUG decrypt: trimmed stored password length=" << password.length() << endl;
-        cout << "DEBUG decrypt: trimmed input password length=" << pw_trimmed.length() << endl;
-        cout.flush();
-        
-        if (password != pw_trimmed) {
-            cout << "DEBUG decrypt: Password mismatch!" << endl;
-            cout.flush();
-            return ERROR_PW_NOT_MATCH_CN;
-        }
+// In-memory counterparts of encryptFile/decryptFile: same .claudo layout, no files involved.
+// The input is only read; an empty return means success, otherwise it is one of the ERROR_* messages.
+string Lockstitch::encryptBuffer(const unsigned char* data, size_t size, vector<unsigned char>& out, string extension, string pw, int headSize)
+{
+    SegmentList segments;
+    string startLocation = encryptData(data, size, segments, extension, headSize);
+    string trailer = makeTrailer(extension, pw);
+    segments.add((const unsigned char*)startLocation.data(), startLocation.length());
+    segments.add((const unsigned char*)trailer.data(), trailer.length());
 
-        cout << "DEBUG decrypt: Password matched!" << endl;
-        cout.flush();
-
-        copy(content.end() - 16, content.end(), arr);
-        content.erase(content.end() - 16, content.end());
-        
-        // Read extension as UTF-8 bytes (16 bytes)
-        string extension_utf8 = xorString(prefixData, arr, 16);
-        
-        // Trim trailing spaces
-        size_t ext_end = extension_utf8.find_last_not_of(' ');
-        if (ext_end != string::npos)
-            extension_utf8 = extension_utf8.substr(0, ext_end + 1);
-        
-        cout << "File extension: '" << extension_utf8 << "'" << endl;
-        cout << "DEBUG: About to call decryptData" << endl;
-        cout.flush();
-        
-        if (decryptData(content, extension_utf8) == 1) {
-            cout << "DEBUG: decryptData returned 1 (failure)" << endl;
-            cout.flush();
-            return ERROR_DECRYPT_FAIL_CN;
-        }
-        
-        cout << "DEBUG: decryptData succeeded" << endl;
-        cout.flush();
+    out.resize(segments.total);
+    gatherSegments(segments, out.data());
 
-        int lastDot = filename.rfind('.');
-        if (lastDot == string::npos)
-            lastDot = filename.length();
+    return "";
+}
 
-        wstring outFilePath = filename.substr(0, lastDot) + L'.' + string_to_wstring(extension_utf8);
-        string utf8_output = wstring_to_string(outFilePath);
+string Lockstitch::decryptBuffer(const unsigned char* data, size_t size, vector<unsigned char>& out, string& extension, string pw)
+{
+    try {
+        if (size < 48)
+            return ERROR_DECRYPT_FAIL;
 
-        ofstream fs(utf8_output, ios::out | ios::binary | ios::trunc);
-        fs.write((char*)content.data(), content.size());
-        fs.close();
+        if (!readTrailer((const char*)data + size - 48, pw, extension))
+            return ERROR_PW_NOT_MATCH;
 
-        return outFilePath;
-    }
-    catch (const ios_base::failure& e) {
-        return ERROR_FILE_IO_FAILURE_CN;
+        SegmentList segments;
+        if (decryptData(data, size - 48, segments, extension) == 1)
+            return ERROR_DECRYPT_FAIL;
+
+        out.resize(segments.total);
+        gatherSegments(segments, out.data());
     }
     catch (const exception& e) {
-        return ERROR_DECRYPT_FAIL_CN;
+        out.clear();
+        return ERROR_DECRYPT_FAIL;
     }
 
-    return ERROR_DECRYPT_FAIL_CN;
+    return "";
 }
 
-int Lockstitch::decryptData(vector<unsigned char>& data, string fielExtion)
+// Lays out the plaintext of size bytes of .claudo data (password/extension trailer excluded) as segments of out
+int Lockstitch::decryptData(const unsigned char* data, size_t size, SegmentList& out, string fielExtion)
 {
-    char preChars[8];
+    ClaudoLayout layout;
+    if (readLayout(data + size, size, fielExtion, layout) != 0)
+        return 1;
+
+    // The header copy at the front is dropped; the original bytes are also in what follows it
+    if (layout.prefixSize)
+    {
+        vector<unsigned char> data1(data + layout.prefixOffset, data + layout.prefixOffset + layout.prefixSize);
+        out.add(divString(data1, *layout.key));
+    }
+    out.add(data + layout.bodyOffset, layout.bodySize, layout.key, 0);
+
+    return 0;
+}
+
+// Lays out the .claudo form of size bytes of data as segments of out; returns the encoded start position
+string Lockstitch::encryptData(const unsigned char* data, size_t size, SegmentList& out, string fielExtion, int headSize, int number)
+{
+    if (headSize)
+        headSize = min((size_t)headSize, size);
+
+    if (number == 0)
+        number = getEncodePaterStartPos();
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, FILE_KEY_SIZE);
+
+    toUpper(fielExtion);
+    bool video = fielExtion == "MP4" || fielExtion == "MOV";
+    size_t hexSize = encryptHead(data, size, out, key, video, headSize);
+    out.add(encryptTail(video, hexSize, headSize));
+
+    return getStartLocation(number);
+}
+
+// Header, hex product of the mul/div prefix and the XORed rest of data; returns the product's length
+size_t Lockstitch::encryptHead(const unsigned char* data, size_t size, SegmentList& out, const shared_ptr<const KeySlice>& key, bool video, int headSize)
+{
+    // The header goes out unencrypted ahead of everything else
+    out.add(data, headSize);
+    if (video)
+    {
+        out.add(data, size, key, 0);
+        return 0;
+    }
+
+    size_t vsize = min(size, (size_t)MUL_DIV_DATA_SIZE);
+    vector<unsigned char> data1(data, data + vsize);
+    data1 = mulString(data1, *key);
+    data1 = charListToHexCharArray(data1);
+
+    size_t hexSize = data1.size();
+    out.add(move(data1));
+    out.add(data + vsize, size - vsize, key, 0);
+
+    return hexSize;
+}
+
+// Product length (not for video) and header size, written after the body
+vector<unsigned char> Lockstitch::encryptTail(bool video, size_t hexSize, int headSize)
+{
+    vector<unsigned char> words;
+    if (!video)
+    {
+        words.push_back((hexSize & 0xFF000000) >> 24);
+        words.push_back((hexSize & 0x00FF0000) >> 16);
+        words.push_back((hexSize & 0x0000FF00) >> 8);
+        words.push_back(hexSize & 0x000000FF);
+    }
 
+    words.push_back((headSize & 0xFF00) >> 8);
+    words.push_back(headSize & 0x00FF);
+
+    return words;
+}
+
+void Lockstitch::beginEncrypt(EncryptState& state, string extension, string pw, int headSize)
+{
+    state = EncryptState();
+    state.extension = extension;
+    state.pw = pw;
+    state.headSize = headSize;
+    toUpper(extension);
+    state.video = extension == "MP4" || extension == "MOV";
+    state.number = getEncodePaterStartPos();
+    state.key = getKeySlice(state.number, FILE_KEY_SIZE);
+}
+
+// out receives whatever output the input so far allows. Input is held back only until the header
+// and the mul/div prefix are complete; after that each chunk is XORed straight through.
+void Lockstitch::encryptUpdate(EncryptState& state, const unsigned char* data, size_t size, vector<unsigned char>& out)
+{
+    out.clear();
+    if (state.started)
+    {
+        out.resize(size);
+        xorString(data, out.data(), size, *state.key, state.offset);
+        state.offset += size;
+        return;
+    }
+
+    state.pending.insert(state.pending.end(), data, data + size);
+    size_t need = max((size_t)state.headSize, state.video ? (size_t)0 : (size_t)MUL_DIV_DATA_SIZE);
+    if (state.pending.size() >= need)
+        startEncrypt(state, out);
+}
+
+void Lockstitch::startEncrypt(EncryptState& state, vector<unsigned char>& out)
+{
+    size_t size = state.pending.size();
+    if (state.headSize)
+        state.headSize = min((size_t)state.headSize, size);
+
+    SegmentList segments;
+    state.hexSize = encryptHead(state.pending.data(), size, segments, state.key, state.video, state.headSize);
+    state.offset = state.video ? size : size - min(size, (size_t)MUL_DIV_DATA_SIZE);
+
+    out.resize(segments.total);
+    gatherSegments(segments, out.data());
+    state.pending = vector<unsigned char>();
+    state.started = true;
+}
+
+// Closes the output with the size words, start position and password/extension trailer
+void Lockstitch::encryptFinal(EncryptState& state, vector<unsigned char>& out)
+{
+    out.clear();
+    if (!state.started)
+        startEncrypt(state, out);
+
+    vector<unsigned char> words = encryptTail(state.video, state.hexSize, state.headSize);
+    string startLocation = getStartLocation(state.number);
+    string trailer = makeTrailer(state.extension, state.pw);
+    out.insert(out.end(), words.begin(), words.end());
+    out.insert(out.end(), startLocation.begin(), startLocation.end());
+    out.insert(out.end(), trailer.begin(), trailer.end());
+}
+
+// Concatenates segments into out, which must hold segments.total bytes
+void Lockstitch::gatherSegments(const SegmentList& segments, unsigned char* out)
+{
+    for (const Segment& s : segments.parts)
+    {
+        if (s.key)
+            xorString(s.data, out, s.size, *s.key, s.keyOffset);
+        else
+            memcpy(out, s.data, s.size);
+        out += s.size;
+    }
+}
+
+// Bulk reads and writes of the file paths, timed into the load and write phases
+static bool timedRead(const FileReader& in, size_t offset, void* buf, size_t n)
+{
+    PhaseTimer timer(STAT_LOAD, n);
+    return in.readAt(offset, buf, n) == n;
+}
+
+static bool timedWrite(FileWriter& out, size_t offset, const unsigned char* data, size_t n)
+{
+    PhaseTimer timer(STAT_WRITE, n);
+    return out.writeAt(offset, data, n);
+}
+
+// Writes segments at offset in out, which must already be allocated. The output is split into
+// ranges across the worker pool; each one is XORed into its own buffer and written in place.
+bool Lockstitch::writeSegments(const SegmentList& segments, FileWriter& out, size_t offset)
+{
+    vector<size_t> starts(segments.parts.size());
+    for (size_t i = 0, pos = 0; i < starts.size(); pos += segments.parts[i++].size)
+        starts[i] = pos;
+
+    atomic<bool> ok(true);
+    WorkerPool::forLane(LANE_FILE).parallelFor(segments.total, 1, STREAM_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        ArenaScope scope;
+        unsigned char* block = nullptr;
+        size_t blockSize = 0;
+        size_t i = upper_bound(starts.begin(), starts.end(), begin) - starts.begin() - 1;
+        for (size_t pos = begin; pos < end && ok; ++i)
+        {
+            const Segment& s = segments.parts[i];
+            size_t from = pos - starts[i];
+            size_t n = min(end, starts[i] + s.size) - pos;
+            if (!s.key)
+            {
+                if (!timedWrite(out, offset + pos, s.data + from, n))
+                    ok = false;
+                pos += n;
+                continue;
+            }
+
+            // One block per range, taken at its first XORed segment and reused for the rest
+            if (!block)
+            {
+                blockSize = min(end - begin, (size_t)STREAM_BLOCK_SIZE);
+                block = scope.alloc<unsigned char>(blockSize);
+            }
+            for (size_t done = 0; done < n && ok; done += blockSize)
+            {
+                size_t m = min(n - done, blockSize);
+                xorString(s.data + from + done, block, m, *s.key, s.keyOffset + from + done);
+                if (!timedWrite(out, offset + pos + done, block, m))
+                    ok = false;
+            }
+            pos += n;
+        }
+    });
+
+    return ok;
+}
+
+// Same layout as encryptData followed by the start location and trailer, read from in and
+// written at known offsets into out
+bool Lockstitch::encryptStream(const FileReader& in, FileWriter& out, size_t size, string fielExtion, int headSize, const string& trailer)
+{
+    if (headSize)
+        headSize = min((size_t)headSize, size);
+
+    int number = getEncodePaterStartPos();
+    const shared_ptr<const KeySlice>& key = getKeySlice(number, FILE_KEY_SIZE);
+
+    toUpper(fielExtion);
+    bool video = fielExtion == "MP4" || fielExtion == "MOV";
+    size_t vsize = video ? 0 : min(size, (size_t)MUL_DIV_DATA_SIZE);
+
+    // Header and mul/div prefix both come from the start of the file
+    vector<unsigned char> first(max((size_t)headSize, vsize));
+    if (!timedRead(in, 0, first.data(), first.size()))
+        return false;
+
+    vector<unsigned char> hex;
+    if (!video)
+    {
+        vector<unsigned char> data1(first.begin(), first.begin() + vsize);
+        data1 = mulString(data1, *key);
+        hex = charListToHexCharArray(data1);
+    }
+
+    // Everything after the XORed body: hex size, header size, start location, trailer
+    vector<unsigned char> tail;
+    if (!video)
+    {
+        size_t hexSize = hex.size();
+        tail.push_back((hexSize & 0xFF000000) >> 24);
+        tail.push_back((hexSize & 0x00FF0000) >> 16);
+        tail.push_back((hexSize & 0x0000FF00) >> 8);
+        tail.push_back(hexSize & 0x000000FF);
+    }
+    tail.push_back((headSize & 0xFF00) >> 8);
+    tail.push_back(headSize & 0x00FF);
+    string startLocation = getStartLocation(number);
+    tail.insert(tail.end(), startLocation.begin(), startLocation.end());
+    tail.insert(tail.end(), trailer.begin(), trailer.end());
+
+    // Key offsets restart at zero right after the prefix
+    size_t body = headSize + hex.size();
+    size_t end = body + (size - vsize);
+
+    return out.allocate(end + tail.size())
+        && timedWrite(out, 0, first.data(), headSize)
+        && timedWrite(out, headSize, hex.data(), hex.size())
+        && xorCopy(in, vsize, out, body, size - vsize, *key, 0)
+        && timedWrite(out, end, tail.data(), tail.size());
+}
+
+// Locates the prefix and body of size bytes of .claudo data (password/extension trailer excluded)
+// from the header size, start location and size word, the last few bytes before end; nothing
+// earlier is read
+int Lockstitch::readLayout(const unsigned char* end, size_t size, string fielExtion, ClaudoLayout& layout)
+{
     int len = getPreNumBufSize();
-    copy(data.end() - len, data.end(), preChars);
-    data.erase(data.end() - len, data.end());
-    int n = data.size() - 1;
-    int headSize = (data[n-1]<<8) + data[n]; 
-    data.erase(data.end()-2, data.end());
-    if (headSize > (data.size() >> 1)) {
-        cout << "Error. Invalid file loaded.  program terminated.";
+    if (size < (size_t)len + 2)
+        return 1;
+
+    char preChars[8];
+    copy(end - len, end, preChars);
+    size_t n = size - len - 2;
+    size_t headSize = (end[-len - 2] << 8) + end[-len - 1];
+    if (headSize > (n >> 1)) {
+        LOG_DEBUG("invalid file: header size " << headSize << " exceeds half of the " << n << "-byte payload");
         return 1;
     }
 
-    if(headSize > 0)
-        data.erase(data.begin(), data.begin() + headSize);
-        
     string str1 = xorString(prefixData, preChars, len);
     int number = atoi(str1.c_str());
-    cout << "DEBUG decryptData: number=" << number << ", constantString.length()=" << m_constantString.length() << ", str1='" << str1 << "'" << endl;
-    if (number == 0|| number + 10 > m_constantString.length()) {
-        cout << "Error. Invalid file loaded.  program terminated.";
+    // The start location selects the key, so only its validity is logged
+    if (number == 0 || (size_t)number + TEXT_KEY_SIZE > m_constantString.length()) {
+        LOG_DEBUG("invalid file: bad key start location");
         return 1;
     }
-    
-    string str2 = m_constantString.substr(number);
-    size_t size = min((size_t)1000, str2.length());
-    str2 = str2.substr(0, size);
+
+    layout.key = getKeySlice(number, FILE_KEY_SIZE);
+    layout.headSize = headSize;
+    layout.prefixOffset = headSize;
     toUpper(fielExtion);
-    if (fielExtion =="MP4" || fielExtion == "MOV")
+    if (fielExtion == "MP4" || fielExtion == "MOV")
     {
-        xorString(data, str2);
+        layout.prefixSize = 0;
+        layout.bodyOffset = headSize;
+        layout.bodySize = n - headSize;
+        return 0;
     }
-    else {
-        n = n - 2 - headSize;
-        size_t data1_Size = (data[n - 3] << 24) + (data[n - 2] << 16) + (data[n - 1] << 8) + data[n];
-        data.erase(data.end() - 4, data.end());
-        vector<unsigned char> data1;
-        data1.insert(data1.end(), data.begin(), data.begin() + data1_Size);
-        data.erase(data.begin(), data.begin() + data1_Size);
 
-        data1 = divString(data1, str2);
-        xorString(data, str2);
-        data.insert(data.begin(), data1.begin(), data1.end());
-    }
+    if (n < headSize + 4)
+        return 1;
+
+    const unsigned char* sizeWord = end - len - 6;
+    size_t data1_Size = ((size_t)sizeWord[0] << 24) + (sizeWord[1] << 16) + (sizeWord[2] << 8) + sizeWord[3];
+    if (data1_Size > n - 4 - headSize)
+        return 1;
+
+    layout.prefixSize = data1_Size;
+    layout.bodyOffset = headSize + data1_Size;
+    layout.bodySize = n - 4 - headSize - data1_Size;
 
     return 0;
 }
 
-string Lockstitch::encryptData(vector<unsigned char>& data, string fielExtion, int headSize)
+// Password, extension and layout of an encrypted file, all from one read at its end, so a wrong
+// password or a file that is not .claudo fails before any of the payload is read.
+// Returns "" or the ERROR_* message decryptFile gives for the same file.
+string Lockstitch::checkFile(const FileReader& file, const string& pw, string& extension, ClaudoLayout& layout)
 {
-    unsigned char* header = NULL;
-    if (headSize) {
-        headSize = min((size_t)headSize, data.size());
-        header = new unsigned char[headSize];
-        copy(data.begin(), data.begin() + headSize, header);
+    size_t fileSize = file.size();
+    if (fileSize < 48) {
+        LOG_DEBUG("checkFile: " << fileSize << " bytes is too small for the 48-byte trailer");
+        return ERROR_DECRYPT_FAIL;
     }
 
-    int number = getEncodePaterStartPos();
-    string str1 = to_string(number);
-    int bufSize = getPreNumBufSize();
-    int dif = bufSize - str1.length();
-    while (dif-- > 0)
-        str1 = "0" + str1;
+    // Size word, head size and start location, then the trailer
+    unsigned char tail[48 + 4 + 2 + 8];
+    size_t tailSize = min(fileSize, (size_t)(48 + 4 + 2 + getPreNumBufSize()));
+    if (file.readAt(fileSize - tailSize, tail, tailSize) != tailSize)
+        return ERROR_FILE_IO_FAILURE;
 
-    string str2 = m_constantString.substr(number);
-    size_t size = min((size_t)1000, str2.length());
-    str2 = str2.substr(0, size);
+    const unsigned char* trailer = tail + tailSize - 48;
+    if (!readTrailer((const char*)trailer, pw, extension))
+        return ERROR_PW_NOT_MATCH;
+    if (readLayout(trailer, fileSize - 48, extension, layout) != 0)
+        return ERROR_DECRYPT_FAIL;
 
-    toUpper(fielExtion);
-    if (fielExtion == "MP4" || fielExtion == "MOV")
-    {
-        xorString(data, str2);
-    }
-    else {
-        size_t vsize = min(data.size(), (size_t)MUL_DIV_DATA_SIZE);
-        vector<unsigned char> data1;
-        data1.insert(data1.end(), data.begin(), data.begin() + vsize);
-        data.erase(data.begin(), data.begin() + vsize);
+    return "";
+}
+
+// Reverses encryptStream for a file whose layout checkFile has read. Returns 1 if a read or write fails.
+int Lockstitch::decryptStream(const FileReader& in, const ClaudoLayout& layout, FileWriter& out)
+{
+    vector<unsigned char> data1(layout.prefixSize);
+    if (!timedRead(in, layout.prefixOffset, data1.data(), data1.size()))
+        return 1;
+    data1 = divString(data1, *layout.key);
+
+    // The quotient's length is only known now, and fixes where the XORed rest goes
+    bool ok = out.allocate(data1.size() + layout.bodySize)
+        && timedWrite(out, 0, data1.data(), data1.size())
+        && xorCopy(in, layout.bodyOffset, out, data1.size(), layout.bodySize, *layout.key, 0);
+
+    return ok ? 0 : 1;
+}
 
-        data1 = mulString(data1, str2);
-        data1 = charListToHexCharArray(data1);
-        xorString(data, str2);
-        data.insert(data.begin(), data1.begin(), data1.end());
+string Lockstitch::decryptRange(string fileName, string pw, size_t offset, size_t length, vector<unsigned char>& out, string& extension, size_t& totalSize)
+{
+    out.clear();
+    totalSize = 0;
+    ClaudoRange range;
+    string error = openRange(fileName, pw, range);
+    extension = range.info.extension;
+    if (!error.empty())
+        return error;
+
+    totalSize = range.totalSize;
+    return readRange(range, offset, length, out);
+}
 
-        vsize = data1.size();
-        data.push_back((vsize & 0xFF000000) >> 24);
-        data.push_back((vsize & 0x00FF0000) >> 16);
-        data.push_back((vsize & 0x0000FF00) >> 8);
-        data.push_back(vsize & 0x000000FF);
+string Lockstitch::openRange(string fileName, string pw, ClaudoRange& range)
+{
+    range = ClaudoRange();
+    try {
+        FileReader file(fileName);
+        if (!file.isOpen())
+            return ERROR_FILE_IO_FAILURE;
+
+        string error = checkFile(file, pw, range.info.extension, range.info.layout);
+        if (!error.empty())
+            return error;
+
+        const ClaudoLayout& layout = range.info.layout;
+        vector<unsigned char> quotient(layout.prefixSize);
+        if (!timedRead(file, layout.prefixOffset, quotient.data(), quotient.size()))
+            return ERROR_FILE_IO_FAILURE;
+
+        range.quotient = divString(quotient, *layout.key);
+        range.fileName = fileName;
+        range.info.fileSize = file.size();
+        range.totalSize = range.quotient.size() + layout.bodySize;
+    }
+    catch (const exception& e) {
+        range.quotient.clear();
+        return ERROR_DECRYPT_FAIL;
     }
 
-    data.push_back((headSize & 0xFF00) >> 8);
-    data.push_back(headSize & 0x00FF);
+    return "";
+}
 
-    if (headSize) {
-        for (int i = headSize - 1; i >= 0; --i)
-            data.insert(data.begin(), header[i]);
+string Lockstitch::readRange(const ClaudoRange& range, size_t offset, size_t length, vector<unsigned char>& out)
+{
+    out.clear();
+    try {
+        FileReader file(range.fileName);
+        if (!file.isOpen() || file.size() != range.info.fileSize)
+            return ERROR_FILE_IO_FAILURE;
+
+        // The plaintext is the prefix quotient followed by the body, so body byte i has key offset i
+        const vector<unsigned char>& quotient = range.quotient;
+        offset = min(offset, range.totalSize);
+        length = min(length, range.totalSize - offset);
+        out.resize(length);
+
+        size_t fromQuotient = offset < quotient.size() ? min(length, quotient.size() - offset) : 0;
+        if (fromQuotient)
+            memcpy(out.data(), quotient.data() + offset, fromQuotient);
+
+        size_t bodyPos = offset + fromQuotient - quotient.size();
+        size_t rest = length - fromQuotient;
+        if (!timedRead(file, range.info.layout.bodyOffset + bodyPos, out.data() + fromQuotient, rest))
+        {
+            out.clear();
+            return ERROR_FILE_IO_FAILURE;
+        }
 
-        delete[]header;
+        xorString(out.data() + fromQuotient, rest, *range.info.layout.key, bodyPos);
+    }
+    catch (const exception& e) {
+        out.clear();
+        return ERROR_DECRYPT_FAIL;
     }
 
+    return "";
+}
+
+// Copies count bytes from in (starting at inOffset) to out (starting at outOffset), XORing them
+// against the key stream starting at offset. Ranges are spread over the worker pool.
+bool Lockstitch::xorCopy(const FileReader& in, size_t inOffset, FileWriter& out, size_t outOffset, size_t count, const KeySlice& key, size_t offset)
+{
+    atomic<bool> ok(true);
+    WorkerPool::forLane(LANE_FILE).parallelFor(count, 1, STREAM_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        ArenaScope scope;
+        size_t blockSize = min(end - begin, (size_t)STREAM_BLOCK_SIZE);
+        unsigned char* block = scope.alloc<unsigned char>(blockSize);
+        for (size_t pos = begin; pos < end && ok; pos += blockSize)
+        {
+            size_t n = min(end - pos, blockSize);
+            if (!timedRead(in, inOffset + pos, block, n))
+            {
+                ok = false;
+                break;
+            }
+
+            xorString(block, n, key, offset + pos);
+            if (!timedWrite(out, outOffset + pos, block, n))
+                ok = false;
+        }
+    });
+
+    return ok;
+}
+
+string Lockstitch::getStartLocation(int number)
+{
+    string str1 = to_string(number);
+    int bufSize = getPreNumBufSize();
+    int dif = bufSize - str1.length();
+    while (dif-- > 0)
+        str1 = "0" + str1;
+
     return xorString(prefixData, str1, bufSize);
 }
 
+size_t Lockstitch::setThreadCount(size_t threads)
+{
+    WorkerPool::forLane(LANE_TEXT).setThreadCount(threads);
+    WorkerPool::forLane(LANE_FILE).setThreadCount(threads);
+
+    return WorkerPool::forLane(LANE_FILE).threadCount();
+}
+
 void Lockstitch::toUpper(string& s)
 {
     transform(s.begin(), s.end(), s.begin(),
         [](unsigned char c) { return std::toupper(c); });
 }
 
-int Lockstitch::getEncodePaterStartPos()
+int Lockstitch::getEncodePaterStartPos() const
 {
-    time_t seconds = time(NULL);
-    srand(seconds);
+    // Per-thread generator instead of the process-wide srand()/rand() state
+    thread_local mt19937 rng(random_device{}() ^ (unsigned)hash<thread::id>()(this_thread::get_id()));
     int len = m_constantString.length();
-    int number = 0;
-    while (number == 0)
-        number = rand() % (len - 10);
+    uniform_int_distribution<int> dist(1, len - 11);
 
-    return number;
+    return dist(rng);
 }
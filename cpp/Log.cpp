@@ -0,0 +1,50 @@
+// Log.cpp
+// Leveled stderr logging for the Lockstitch core
+
+#include "Log.h"
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+using namespace std;
+
+static int initialLevel()
+{
+    const char* env = getenv("LOCKSTITCH_LOG_LEVEL");
+    int level = env ? Log::parseLevel(env) : -1;
+
+    return level < 0 ? LOG_LEVEL_WARN : level;
+}
+
+atomic<int> Log::s_level(initialLevel());
+
+void Log::setLevel(int level)
+{
+    s_level.store(level < LOG_LEVEL_OFF ? LOG_LEVEL_OFF : level > LOG_LEVEL_DEBUG ? LOG_LEVEL_DEBUG : level, memory_order_relaxed);
+}
+
+int Log::parseLevel(const string& name)
+{
+    static const char* const names[] = { "off", "error", "warn", "info", "debug" };
+    for (int i = LOG_LEVEL_OFF; i <= LOG_LEVEL_DEBUG; ++i)
+        if (name == names[i])
+            return i;
+
+    return -1;
+}
+
+void Log::write(int level, const string& message)
+{
+    static const char* const tags[] = { "", "error", "warn", "info", "debug" };
+    string line = string("[lockstitch ") + tags[level] + "] " + message + "\n";
+
+    // A single write() keeps concurrent messages from interleaving and bypasses stdio buffering
+    size_t done = 0;
+    while (done < line.size())
+    {
+        ssize_t n = ::write(STDERR_FILENO, line.data() + done, line.size() - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+}
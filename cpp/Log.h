@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <atomic>
+using namespace std;
+
+#define LOG_LEVEL_OFF 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are compiled out entirely; build with -DLOCKSTITCH_LOG_MAX=4 for debug output
+#ifndef LOCKSTITCH_LOG_MAX
+#define LOCKSTITCH_LOG_MAX LOG_LEVEL_INFO
+#endif
+
+// Leveled diagnostics on stderr, one write per message.
+// The runtime level comes from LOCKSTITCH_LOG_LEVEL (off, error, warn, info, debug; default warn).
+// Passwords, key material and key start locations are never logged, not even at debug level.
+class Log
+{
+public:
+	static bool enabled(int level) { return level <= s_level.load(memory_order_relaxed); }
+	static void setLevel(int level);
+	static int level() { return s_level.load(memory_order_relaxed); }
+	// "off", "error", "warn", "info" or "debug"; -1 when unknown
+	static int parseLevel(const string& name);
+
+	static void write(int level, const string& message);
+
+private:
+	static atomic<int> s_level;
+};
+
+// The message expression is only evaluated when the level is both compiled in and enabled
+#define LOCKSTITCH_LOG(level, expr) \
+	do { \
+		if ((level) <= LOCKSTITCH_LOG_MAX && Log::enabled(level)) \
+		{ \
+			ostringstream log_stream_; \
+			log_stream_ << expr; \
+			Log::write(level, log_stream_.str()); \
+		} \
+	} while (0)
+
+#define LOG_ERROR(expr) LOCKSTITCH_LOG(LOG_LEVEL_ERROR, expr)
+#define LOG_WARN(expr) LOCKSTITCH_LOG(LOG_LEVEL_WARN, expr)
+#define LOG_INFO(expr) LOCKSTITCH_LOG(LOG_LEVEL_INFO, expr)
+#define LOG_DEBUG(expr) LOCKSTITCH_LOG(LOG_LEVEL_DEBUG, expr)
@@ -0,0 +1,106 @@
+// Stats.cpp
+// Per-phase counters and duration histograms for the Lockstitch hot paths
+
+#include "Stats.h"
+#include <algorithm>
+
+using namespace std;
+
+Stats::Phase Stats::s_phases[STAT_PHASE_COUNT];
+
+static const char* const phaseNames[STAT_PHASE_COUNT] = { "load", "muldiv", "hex", "xor", "write", "textWait", "fileWait" };
+
+// Log-linear: the power of two of ns plus the next STAT_SUB_BITS bits below the top one
+size_t Stats::bucketOf(uint64_t ns)
+{
+    if (ns < STAT_SUB_BUCKETS)
+        return (size_t)ns;
+
+    int e = 63 - __builtin_clzll(ns);
+    size_t sub = (size_t)(ns >> (e - STAT_SUB_BITS)) & (STAT_SUB_BUCKETS - 1);
+
+    return (size_t)(e - STAT_SUB_BITS + 1) * STAT_SUB_BUCKETS + sub;
+}
+
+uint64_t Stats::bucketMid(size_t bucket)
+{
+    if (bucket < STAT_SUB_BUCKETS)
+        return bucket;
+
+    int shift = (int)(bucket / STAT_SUB_BUCKETS) - 1;
+    uint64_t width = (uint64_t)1 << shift;
+    uint64_t low = (uint64_t)(STAT_SUB_BUCKETS + bucket % STAT_SUB_BUCKETS) << shift;
+
+    return low + width / 2;
+}
+
+void Stats::record(StatPhase phase, uint64_t ns, uint64_t bytes)
+{
+    Phase& p = s_phases[phase];
+    p.calls.fetch_add(1, memory_order_relaxed);
+    p.bytes.fetch_add(bytes, memory_order_relaxed);
+    p.totalNs.fetch_add(ns, memory_order_relaxed);
+    p.buckets[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+
+    uint64_t max = p.maxNs.load(memory_order_relaxed);
+    while (ns > max && !p.maxNs.compare_exchange_weak(max, ns, memory_order_relaxed))
+        ;
+}
+
+uint64_t Stats::percentile(const vector<uint64_t>& counts, uint64_t total, double q)
+{
+    if (total == 0)
+        return 0;
+
+    // Rank of the q-quantile, 1-based
+    uint64_t rank = (uint64_t)(q * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            return bucketMid(i);
+    }
+
+    return bucketMid(counts.size() - 1);
+}
+
+// Counters are read one by one while other threads may be recording, so a snapshot
+// can be off by the calls in flight
+vector<PhaseStats> Stats::snapshot()
+{
+    vector<PhaseStats> result;
+    vector<uint64_t> counts(STAT_BUCKETS);
+    for (int i = 0; i < STAT_PHASE_COUNT; ++i)
+    {
+        Phase& p = s_phases[i];
+        uint64_t total = 0;
+        for (size_t b = 0; b < STAT_BUCKETS; ++b)
+            total += counts[b] = p.buckets[b].load(memory_order_relaxed);
+
+        PhaseStats s;
+        s.name = phaseNames[i];
+        s.calls = p.calls.load(memory_order_relaxed);
+        s.bytes = p.bytes.load(memory_order_relaxed);
+        s.totalNs = p.totalNs.load(memory_order_relaxed);
+        s.maxNs = p.maxNs.load(memory_order_relaxed);
+        s.p50Ns = min(percentile(counts, total, 0.50), s.maxNs);
+        s.p99Ns = min(percentile(counts, total, 0.99), s.maxNs);
+        result.push_back(s);
+    }
+
+    return result;
+}
+
+void Stats::reset()
+{
+    for (Phase& p : s_phases)
+    {
+        p.calls.store(0, memory_order_relaxed);
+        p.bytes.store(0, memory_order_relaxed);
+        p.totalNs.store(0, memory_order_relaxed);
+        p.maxNs.store(0, memory_order_relaxed);
+        for (atomic<uint64_t>& b : p.buckets)
+            b.store(0, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+// Phases timed on the encrypt/decrypt hot paths
+enum StatPhase
+{
+	STAT_LOAD,		// file reads
+	STAT_MULDIV,	// bignum multiply/divide of the 40 KB prefix (and of strings)
+	STAT_HEX,		// hex expansion of the product
+	STAT_XOR,		// key-stream XOR
+	STAT_WRITE,		// output writes
+	STAT_TEXT_WAIT,	// queue wait of text-lane jobs (JobScheduler)
+	STAT_FILE_WAIT,	// queue wait of file-lane jobs
+	STAT_PHASE_COUNT
+};
+
+struct PhaseStats
+{
+	const char* name;
+	uint64_t calls;
+	uint64_t bytes;
+	uint64_t totalNs;
+	uint64_t maxNs;
+	// Bucket midpoints from the histogram, so within about 12% of the true value
+	uint64_t p50Ns;
+	uint64_t p99Ns;
+};
+
+// Four buckets per power of two of the duration in nanoseconds
+#define STAT_SUB_BITS 2
+#define STAT_SUB_BUCKETS (1 << STAT_SUB_BITS)
+#define STAT_BUCKETS (64 * STAT_SUB_BUCKETS)
+
+// Process-wide per-phase counters and duration histograms; every update is a relaxed atomic add.
+// Build with -DLOCKSTITCH_NO_STATS to compile the timers out.
+class Stats
+{
+public:
+	static void record(StatPhase phase, uint64_t ns, uint64_t bytes);
+	static vector<PhaseStats> snapshot();
+	static void reset();
+
+private:
+	struct alignas(64) Phase
+	{
+		atomic<uint64_t> calls{ 0 };
+		atomic<uint64_t> bytes{ 0 };
+		atomic<uint64_t> totalNs{ 0 };
+		atomic<uint64_t> maxNs{ 0 };
+		atomic<uint64_t> buckets[STAT_BUCKETS] = {};
+	};
+
+	static size_t bucketOf(uint64_t ns);
+	static uint64_t bucketMid(size_t bucket);
+	static uint64_t percentile(const vector<uint64_t>& counts, uint64_t total, double q);
+
+	static Phase s_phases[STAT_PHASE_COUNT];
+};
+
+// Times its own lifetime into one phase
+class PhaseTimer
+{
+public:
+#ifndef LOCKSTITCH_NO_STATS
+	explicit PhaseTimer(StatPhase phase, size_t bytes = 0) : m_phase(phase), m_bytes(bytes), m_start(chrono::steady_clock::now()) {}
+	~PhaseTimer() { Stats::record(m_phase, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_start).count(), m_bytes); }
+	// For phases whose size is only known once they finish
+	void setBytes(size_t bytes) { m_bytes = bytes; }
+#else
+	explicit PhaseTimer(StatPhase, size_t = 0) {}
+	void setBytes(size_t) {}
+#endif
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+#ifndef LOCKSTITCH_NO_STATS
+private:
+	StatPhase m_phase;
+	size_t m_bytes;
+	chrono::steady_clock::time_point m_start;
+#endif
+};
@@ -0,0 +1,202 @@
+// Utf8.cpp
+// UTF-8 validation and wchar_t transcoding with a vectorized ASCII fast path
+
+#include "Utf8.h"
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define UTF8_NEON
+#endif
+
+using namespace std;
+
+size_t Utf8::asciiPrefix(const char* str, size_t n)
+{
+    const unsigned char* s = (const unsigned char*)str;
+    size_t i = 0;
+#if defined(UTF8_SSE2)
+    for (; i + 16 <= n; i += 16)
+    {
+        int high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)));
+        if (high)
+            return i + __builtin_ctz(high);
+    }
+#elif defined(UTF8_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        if (vmaxvq_u8(vld1q_u8(s + i)) >= 0x80)
+            break;
+    }
+#endif
+    while (i < n && s[i] < 0x80)
+        ++i;
+
+    return i;
+}
+
+// Length of the sequence at s with its code point in cp, or 0 if it is malformed
+static inline size_t decodeOne(const unsigned char* s, size_t n, uint32_t& cp)
+{
+    unsigned char c = s[0];
+    size_t len;
+    uint32_t min;
+    if (c < 0x80)
+    {
+        cp = c;
+        return 1;
+    }
+    else if (c >= 0xC2 && c <= 0xDF)
+    {
+        len = 2;
+        min = 0x80;
+        cp = c & 0x1F;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        len = 3;
+        min = 0x800;
+        cp = c & 0x0F;
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        len = 4;
+        min = 0x10000;
+        cp = c & 0x07;
+    }
+    else
+        return 0;
+
+    if (len > n)
+        return 0;
+    for (size_t k = 1; k < len; ++k)
+    {
+        if ((s[k] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[k] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return 0;
+
+    return len;
+}
+
+bool Utf8::valid(const char* str, size_t n)
+{
+    const unsigned char* s = (const unsigned char*)str;
+    size_t i = 0;
+    while (i < n)
+    {
+        if (s[i] < 0x80)
+        {
+            i += asciiPrefix(str + i, n - i);
+            continue;
+        }
+
+        uint32_t cp;
+        size_t len = decodeOne(s + i, n - i, cp);
+        if (!len)
+            return false;
+        i += len;
+    }
+
+    return true;
+}
+
+size_t Utf8::length(const char* s, size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+        count += ((unsigned char)s[i] & 0xC0) != 0x80;
+
+    return count;
+}
+
+bool Utf8::toWide(const char* str, size_t n, wstring& out)
+{
+    const unsigned char* s = (const unsigned char*)str;
+    // Never more code units than bytes, for either width of wchar_t
+    out.resize(n);
+    size_t i = 0, o = 0;
+    while (i < n)
+    {
+        if (s[i] < 0x80)
+        {
+            size_t run = asciiPrefix(str + i, n - i);
+            for (size_t k = 0; k < run; ++k)
+                out[o + k] = (wchar_t)s[i + k];
+            i += run;
+            o += run;
+            continue;
+        }
+
+        uint32_t cp;
+        size_t len = decodeOne(s + i, n - i, cp);
+        if (!len)
+            return false;
+        i += len;
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+        {
+            cp -= 0x10000;
+            out[o++] = (wchar_t)(0xD800 + (cp >> 10));
+            out[o++] = (wchar_t)(0xDC00 + (cp & 0x3FF));
+        }
+        else
+            out[o++] = (wchar_t)cp;
+    }
+    out.resize(o);
+
+    return true;
+}
+
+bool Utf8::fromWide(const wchar_t* s, size_t n, string& out)
+{
+    out.resize(n * (sizeof(wchar_t) == 2 ? 3 : 4));
+    size_t o = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t cp = (uint32_t)s[i];
+        if (cp < 0x80)
+        {
+            out[o++] = (char)cp;
+            continue;
+        }
+
+        if (cp >= 0xD800 && cp <= 0xDFFF)
+        {
+            // Only a high surrogate followed by a low one, and only in UTF-16
+            if (sizeof(wchar_t) != 2 || cp > 0xDBFF || i + 1 == n)
+                return false;
+            uint32_t low = (uint32_t)s[i + 1];
+            if (low < 0xDC00 || low > 0xDFFF)
+                return false;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            ++i;
+        }
+        else if (cp > 0x10FFFF)
+            return false;
+
+        if (cp < 0x800)
+        {
+            out[o++] = (char)(0xC0 | (cp >> 6));
+        }
+        else if (cp < 0x10000)
+        {
+            out[o++] = (char)(0xE0 | (cp >> 12));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        }
+        else
+        {
+            out[o++] = (char)(0xF0 | (cp >> 18));
+            out[o++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        }
+        out[o++] = (char)(0x80 | (cp & 0x3F));
+    }
+    out.resize(o);
+
+    return true;
+}
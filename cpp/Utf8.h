@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// UTF-8 <-> wchar_t transcoding for the wstring entry points, replacing the deprecated wstring_convert.
+// wchar_t is taken as UTF-32 when it is 4 bytes wide and as UTF-16 when it is 2 bytes wide.
+// ASCII runs, the common case for paths and passwords, are found 16 bytes at a time (SSE2/NEON).
+// The byte-oriented API needs none of this: paths, passwords and extensions stay UTF-8 throughout.
+class Utf8
+{
+public:
+	// Well-formed UTF-8: no overlong forms, surrogates or code points past U+10FFFF
+	static bool valid(const char* s, size_t n);
+	static bool valid(const string& s) { return valid(s.data(), s.length()); }
+	// Code points in s, which must be valid
+	static size_t length(const char* s, size_t n);
+	// False, with out unspecified, on malformed input
+	static bool toWide(const char* s, size_t n, wstring& out);
+	static bool fromWide(const wchar_t* s, size_t n, string& out);
+	// Leading bytes of s below 0x80
+	static size_t asciiPrefix(const char* s, size_t n);
+};
@@ -0,0 +1,167 @@
+// WorkerPool.cpp
+// Thread pool behind the parallel Lockstitch transforms
+
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <new>
+
+using namespace std;
+
+// Set while this thread runs a parallelFor range; nested calls then run inline, since waiting
+// for helpers from inside a range could leave every thread blocked on queued work
+static thread_local bool t_inParallel = false;
+
+WorkerPool& WorkerPool::forLane(JobLane lane)
+{
+    static const size_t threads = getenv("LOCKSTITCH_THREADS") ? strtoul(getenv("LOCKSTITCH_THREADS"), nullptr, 10) : 0;
+    static WorkerPool text(threads);
+    static WorkerPool file(threads);
+    return lane == LANE_TEXT ? text : file;
+}
+
+WorkerPool::WorkerPool(size_t threads) : m_threadCount(0)
+{
+    setThreadCount(threads);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::setThreadCount(size_t threads)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+
+    lock_guard<mutex> config(m_configMutex);
+    if (threads == m_threadCount)
+        return;
+
+    // No parallelFor has helpers queued once this is held, so none can be left waiting on
+    // workers that no longer exist
+    unique_lock<shared_mutex> idle(m_inFlight);
+    stop();
+    start(threads);
+}
+
+void WorkerPool::start(size_t threads)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = false;
+    }
+    for (size_t i = 1; i < threads; ++i)
+        m_threads.emplace_back(&WorkerPool::workerLoop, this);
+    m_threadCount = threads;
+}
+
+void WorkerPool::stop()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (thread& t : m_threads)
+        t.join();
+    m_threads.clear();
+}
+
+void WorkerPool::workerLoop()
+{
+    for (;;)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+
+            task = move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void WorkerPool::parallelFor(size_t n, size_t align, size_t minChunk, const function<void(size_t, size_t)>& fn)
+{
+    if (n == 0)
+        return;
+
+    if (t_inParallel)
+    {
+        fn(0, n);
+        return;
+    }
+
+    shared_lock<shared_mutex> inFlight(m_inFlight);
+    align = max((size_t)1, align);
+    size_t threads = m_threadCount;
+    size_t chunk = max(minChunk, (n + threads - 1) / threads);
+    chunk = (chunk + align - 1) / align * align;
+    size_t chunks = (n + chunk - 1) / chunk;
+    if (chunks <= 1 || threads <= 1)
+    {
+        // No helpers to wait for, so fn runs unlocked: a parallelFor inside it can still split its
+        // own range, and never takes m_inFlight a second time on this thread
+        inFlight.unlock();
+        fn(0, n);
+        return;
+    }
+
+    // Helpers pull ranges until none are left; the caller does the same, then waits for them.
+    // Everything they share lives in this frame, so the caller always waits, even when fn throws.
+    size_t helpers = min(chunks, threads) - 1;
+    size_t pending = 0;
+    mutex doneMutex;
+    condition_variable doneCv;
+    exception_ptr error;
+
+    atomic<size_t> next(0);
+    auto run = [&]() {
+        t_inParallel = true;
+        try {
+            for (size_t c; (c = next++) < chunks;)
+                fn(c * chunk, min(n, (c + 1) * chunk));
+        }
+        catch (...) {
+            next = chunks;
+            lock_guard<mutex> done(doneMutex);
+            if (!error)
+                error = current_exception();
+        }
+        t_inParallel = false;
+    };
+
+    {
+        // pending counts only the helpers actually queued; none of them starts before m_mutex is released
+        lock_guard<mutex> lock(m_mutex);
+        try {
+            for (; pending < helpers; ++pending)
+            {
+                m_tasks.emplace_back([&]() {
+                    run();
+                    lock_guard<mutex> done(doneMutex);
+                    if (--pending == 0)
+                        doneCv.notify_one();
+                });
+            }
+        }
+        catch (const bad_alloc&) {
+            // Fewer helpers; the caller takes the ranges they would have
+        }
+    }
+    m_cv.notify_all();
+
+    run();
+
+    unique_lock<mutex> done(doneMutex);
+    doneCv.wait(done, [&] { return pending == 0; });
+    if (error)
+        rethrow_exception(error);
+}
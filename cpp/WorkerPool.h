@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+#include "JobScheduler.h"
+using namespace std;
+
+// Fixed set of worker threads for splitting one large transform across cores.
+// The calling thread always takes part, so a count of 1 means no extra threads.
+class WorkerPool
+{
+public:
+	// Process-wide pool for the jobs of one scheduler lane, so that the ranges of a large file job never
+	// queue ahead of a text batch's. LOCKSTITCH_THREADS sets the initial count of each, otherwise all hardware threads.
+	static WorkerPool& forLane(JobLane lane);
+
+	explicit WorkerPool(size_t threads = 0);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// 0 means hardware_concurrency(); waits for running parallelFor calls to finish
+	void setThreadCount(size_t threads);
+	size_t threadCount() const { return m_threadCount; }
+
+	// Calls fn(begin, end) over [0, n) in ranges whose starts are multiples of align
+	// and that are at least minChunk long; returns once every range is done.
+	// A parallelFor made from inside a split range runs on the calling thread only; one made while fn has
+	// the whole of [0, n) on the calling thread may still split. If fn throws, the remaining
+	// ranges are skipped and the first exception is rethrown on the caller once every helper is done.
+	void parallelFor(size_t n, size_t align, size_t minChunk, const function<void(size_t, size_t)>& fn);
+
+private:
+	void start(size_t threads);
+	void stop();
+	void workerLoop();
+
+	vector<thread> m_threads;
+	deque<function<void()>> m_tasks;
+	mutex m_mutex;
+	condition_variable m_cv;
+	bool m_stopping = false;
+	mutex m_configMutex;
+	// Held shared by each parallelFor and exclusively while the workers are replaced
+	shared_mutex m_inFlight;
+	atomic<size_t> m_threadCount;
+};
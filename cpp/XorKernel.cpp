@@ -0,0 +1,181 @@
+// XorKernel.cpp
+// Vectorized repeating-key XOR with runtime dispatch and a portable fallback
+
+#include "XorKernel.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XOR_KERNEL_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define XOR_KERNEL_NEON
+#endif
+
+using namespace std;
+
+// Each kernel reads at most 64 bytes past the current key offset, which KEY_STREAM_PAD covers
+
+static void xorScalar(unsigned char* p, size_t n, const unsigned char* stream, size_t len, size_t j)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, p + i, 8);
+        memcpy(&b, stream + j, 8);
+        a ^= b;
+        memcpy(p + i, &a, 8);
+        j += 8;
+        while (j >= len)
+            j -= len;
+    }
+
+    for (; i < n; ++i)
+    {
+        p[i] ^= stream[j];
+        if (++j == len)
+            j = 0;
+    }
+}
+
+#ifdef XOR_KERNEL_X86
+static void xorSse2(unsigned char* p, size_t n, const unsigned char* stream, size_t len, size_t j)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(stream + j));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_xor_si128(a, b));
+        j += 16;
+        while (j >= len)
+            j -= len;
+    }
+    xorScalar(p + i, n - i, stream, len, j);
+}
+
+__attribute__((target("avx2")))
+static void xorAvx2(unsigned char* p, size_t n, const unsigned char* stream, size_t len, size_t j)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(stream + j));
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_xor_si256(a, b));
+        j += 32;
+        while (j >= len)
+            j -= len;
+    }
+    xorScalar(p + i, n - i, stream, len, j);
+}
+
+__attribute__((target("avx512f")))
+static void xorAvx512(unsigned char* p, size_t n, const unsigned char* stream, size_t len, size_t j)
+{
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m512i a = _mm512_loadu_si512((const void*)(p + i));
+        __m512i b = _mm512_loadu_si512((const void*)(stream + j));
+        _mm512_storeu_si512((void*)(p + i), _mm512_xor_si512(a, b));
+        j += 64;
+        while (j >= len)
+            j -= len;
+    }
+    xorScalar(p + i, n - i, stream, len, j);
+}
+#endif
+
+#ifdef XOR_KERNEL_NEON
+static void xorNeon(unsigned char* p, size_t n, const unsigned char* stream, size_t len, size_t j)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t a = vld1q_u8(p + i);
+        uint8x16_t b = vld1q_u8(stream + j);
+        vst1q_u8(p + i, veorq_u8(a, b));
+        j += 16;
+        while (j >= len)
+            j -= len;
+    }
+    xorScalar(p + i, n - i, stream, len, j);
+}
+#endif
+
+XorKernel::Fn XorKernel::find(const string& name)
+{
+    if (name == "scalar")
+        return xorScalar;
+#ifdef XOR_KERNEL_X86
+    __builtin_cpu_init();
+    if (name == "sse2" && __builtin_cpu_supports("sse2"))
+        return xorSse2;
+    if (name == "avx2" && __builtin_cpu_supports("avx2"))
+        return xorAvx2;
+    if (name == "avx512" && __builtin_cpu_supports("avx512f"))
+        return xorAvx512;
+#endif
+#ifdef XOR_KERNEL_NEON
+    if (name == "neon")
+        return xorNeon;
+#endif
+
+    return nullptr;
+}
+
+// Widest first
+static const char* const kernelNames[] = { "avx512", "avx2", "sse2", "neon", "scalar" };
+
+struct XorKernelChoice
+{
+    XorKernel::Fn fn = xorScalar;
+    const char* name = "scalar";
+
+    XorKernelChoice()
+    {
+        const char* forced = getenv("LOCKSTITCH_XOR_KERNEL");
+        if (!(forced && pick(forced)))
+            pick(nullptr);
+    }
+
+    bool pick(const char* only)
+    {
+        for (const char* candidate : kernelNames)
+        {
+            if (only && strcmp(only, candidate) != 0)
+                continue;
+            if (XorKernel::Fn f = XorKernel::find(candidate))
+            {
+                fn = f;
+                name = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+static const XorKernelChoice& choice()
+{
+    static const XorKernelChoice c;
+    return c;
+}
+
+void XorKernel::apply(unsigned char* data, size_t n, const unsigned char* stream, size_t keyLen, size_t offset)
+{
+    if (keyLen == 0 || n == 0)
+        return;
+
+    choice().fn(data, n, stream, keyLen, offset);
+}
+
+const char* XorKernel::name()
+{
+    return choice().name;
+}
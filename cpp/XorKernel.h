@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// Repeating-key XOR over a key stream unrolled to keyLen + KEY_STREAM_PAD bytes (see KeySlice).
+// The widest kernel the CPU supports is picked on first use; LOCKSTITCH_XOR_KERNEL forces one by name.
+class XorKernel
+{
+public:
+	typedef void (*Fn)(unsigned char* data, size_t n, const unsigned char* stream, size_t keyLen, size_t offset);
+
+	// data[i] ^= key[(offset + i) % keyLen]; offset must be below keyLen
+	static void apply(unsigned char* data, size_t n, const unsigned char* stream, size_t keyLen, size_t offset);
+	// Name of the kernel apply() uses
+	static const char* name();
+	// "avx512", "avx2", "sse2", "neon" or "scalar"; nullptr when unsupported here
+	static Fn find(const string& name);
+};
@@ -1,8 +1,420 @@
 #include <napi.h>
 #include "cpp/Lockstitch.h"
+#include "cpp/Log.h"
+#include "cpp/Stats.h"
+#include "cpp/JobScheduler.h"
+#include "cpp/Arena.h"
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+
+// Stand-in for Napi::AsyncWorker that runs Execute() on a JobScheduler lane instead of the libuv
+// thread pool, so a long file job cannot hold up short string calls. OnOK()/OnError() run on the
+// JS thread, reached through a thread-safe function; the worker deletes itself afterwards.
+class ScheduledWorker {
+public:
+    explicit ScheduledWorker(Napi::Env env) : env(env), failed(false) {}
+    virtual ~ScheduledWorker() {}
+
+    void Queue(JobLane lane) {
+        tsfn = Napi::ThreadSafeFunction::New(env, Napi::Function(), "lockstitch", 0, 1);
+        JobScheduler::shared().submit(lane, [this]() {
+            // Completion may delete this before Release() returns
+            Napi::ThreadSafeFunction done = tsfn;
+            Execute();
+            done.NonBlockingCall(this, [](Napi::Env, Napi::Function, ScheduledWorker* worker) {
+                worker->Complete();
+            });
+            done.Release();
+        });
+    }
+
+protected:
+    virtual void Execute() = 0;
+    virtual void OnOK() = 0;
+    virtual void OnError(const Napi::Error& e) = 0;
+
+    Napi::Env Env() const { return env; }
+    void SetError(const std::string& message) {
+        error = message;
+        failed = true;
+    }
+
+private:
+    void Complete() {
+        if (failed)
+            OnError(Napi::Error::New(env, error));
+        else
+            OnOK();
+        delete this;
+    }
+
+    Napi::Env env;
+    Napi::ThreadSafeFunction tsfn;
+    bool failed;
+    std::string error;
+};
+
+// Runs one Lockstitch call on a scheduler lane and settles a promise with the result.
+// The work function returns false (with the message in result) when the call failed.
+class LockstitchWorker : public ScheduledWorker {
+public:
+    LockstitchWorker(Napi::Env env, std::function<bool(std::string&)> work)
+        : ScheduledWorker(env), deferred(Napi::Promise::Deferred::New(env)), work(work) {}
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    void Execute() override {
+        try {
+            if (!work(result))
+                SetError(result);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+        catch (...) {
+            SetError("Lockstitch operation failed");
+        }
+    }
+
+    void OnOK() override {
+        deferred.Resolve(Napi::String::New(Env(), result));
+    }
+
+    void OnError(const Napi::Error& e) override {
+        deferred.Reject(e.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred;
+    std::function<bool(std::string&)> work;
+    std::string result;
+};
+
+static Napi::Promise RejectedPromise(Napi::Env env, const char* message) {
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::TypeError::New(env, message).Value());
+    return deferred.Promise();
+}
+
+static Napi::Promise QueueWork(Napi::Env env, JobLane lane, std::function<bool(std::string&)> work) {
+    LockstitchWorker* worker = new LockstitchWorker(env, work);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue(lane);
+    return promise;
+}
+
+static bool IsFileError(const std::string& result) {
+    return result == ERROR_FILE_IO_FAILURE || result == ERROR_PW_NOT_MATCH || result == ERROR_DECRYPT_FAIL;
+}
+
+// Array of strings as UTF-8
+static bool GetStrings(Napi::Value value, std::vector<std::string>& out) {
+    if (!value.IsArray())
+        return false;
+    
+    Napi::Array array = value.As<Napi::Array>();
+    uint32_t length = array.Length();
+    out.reserve(length);
+    for (uint32_t i = 0; i < length; ++i) {
+        Napi::Value item = array.Get(i);
+        if (!item.IsString())
+            return false;
+        out.push_back(item.As<Napi::String>().Utf8Value());
+    }
+    return true;
+}
+
+// Combined bytes of a batch, which picks its lane
+static size_t TotalSize(const std::vector<std::string>& strings) {
+    size_t total = 0;
+    for (const std::string& s : strings)
+        total += s.size();
+    return total;
+}
+
+static Napi::Array ToArray(Napi::Env env, const std::vector<std::string>& strings) {
+    Napi::Array array = Napi::Array::New(env, strings.size());
+    for (size_t i = 0; i < strings.size(); ++i)
+        array.Set((uint32_t)i, Napi::String::New(env, strings[i]));
+    return array;
+}
+
+// Batch counterpart of LockstitchWorker; resolves with an array of strings
+class LockstitchBatchWorker : public ScheduledWorker {
+public:
+    LockstitchBatchWorker(Napi::Env env, std::function<void(std::vector<std::string>&)> work)
+        : ScheduledWorker(env), deferred(Napi::Promise::Deferred::New(env)), work(work) {}
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    void Execute() override {
+        try {
+            work(results);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+        catch (...) {
+            SetError("Lockstitch operation failed");
+        }
+    }
+
+    void OnOK() override {
+        deferred.Resolve(ToArray(Env(), results));
+    }
+
+    void OnError(const Napi::Error& e) override {
+        deferred.Reject(e.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred;
+    std::function<void(std::vector<std::string>&)> work;
+    std::vector<std::string> results;
+};
+
+static Napi::Promise QueueBatchWork(Napi::Env env, JobLane lane, std::function<void(std::vector<std::string>&)> work) {
+    LockstitchBatchWorker* worker = new LockstitchBatchWorker(env, work);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue(lane);
+    return promise;
+}
+
+// Buffer or ArrayBuffer contents, read in place
+static bool GetBytes(Napi::Value value, const unsigned char*& data, size_t& size) {
+    if (value.IsBuffer()) {
+        Napi::Buffer<unsigned char> buffer = value.As<Napi::Buffer<unsigned char>>();
+        data = buffer.Data();
+        size = buffer.Length();
+        return true;
+    }
+    if (value.IsArrayBuffer()) {
+        Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+        data = (const unsigned char*)buffer.Data();
+        size = buffer.ByteLength();
+        return true;
+    }
+    return false;
+}
+
+// Hands the vector's storage to a Buffer that frees it when collected
+static Napi::Buffer<unsigned char> ToBuffer(Napi::Env env, std::vector<unsigned char>& bytes) {
+    if (bytes.empty())
+        return Napi::Buffer<unsigned char>::New(env, 0);
+
+    std::vector<unsigned char>* owned = new std::vector<unsigned char>(std::move(bytes));
+    return Napi::Buffer<unsigned char>::NewOrCopy(env, owned->data(), owned->size(),
+        [](Napi::Env, unsigned char*, std::vector<unsigned char>* hint) { delete hint; }, owned);
+}
+
+// Decrypted bytes together with the extension stored in the trailer
+static Napi::Object DecryptedResult(Napi::Env env, std::vector<unsigned char>& bytes, const std::string& extension) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("data", ToBuffer(env, bytes));
+    result.Set("extension", Napi::String::New(env, extension));
+    return result;
+}
+
+// Buffer counterpart of LockstitchWorker. Holds a reference to the input so its memory stays
+// valid while Execute reads it off the main thread; the output vector is handed over without a copy.
+class LockstitchBufferWorker : public ScheduledWorker {
+public:
+    LockstitchBufferWorker(Napi::Env env, Napi::Object input, bool decrypting,
+        std::function<std::string(std::vector<unsigned char>&, std::string&)> work)
+        : ScheduledWorker(env), deferred(Napi::Promise::Deferred::New(env)), input(Napi::Persistent(input)),
+          decrypting(decrypting), work(work) {}
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    // Keeps the object the work runs on alive until the promise settles, and calls settled
+    // on the JS thread just before it does
+    void Hold(Napi::Object object, std::function<void()> settled) {
+        owner = Napi::Persistent(object);
+        this->settled = settled;
+    }
+
+    void Execute() override {
+        try {
+            std::string error = work(output, extension);
+            if (!error.empty())
+                SetError(error);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+        catch (...) {
+            SetError("Lockstitch operation failed");
+        }
+    }
+
+    void OnOK() override {
+        Release();
+        if (decrypting)
+            deferred.Resolve(DecryptedResult(Env(), output, extension));
+        else
+            deferred.Resolve(ToBuffer(Env(), output));
+    }
+
+    void OnError(const Napi::Error& e) override {
+        Release();
+        deferred.Reject(e.Value());
+    }
+
+private:
+    void Release() {
+        if (settled)
+            settled();
+        input.Reset();
+        owner.Reset();
+    }
+
+    Napi::Promise::Deferred deferred;
+    Napi::ObjectReference input;
+    Napi::ObjectReference owner;
+    std::function<void()> settled;
+    bool decrypting;
+    std::function<std::string(std::vector<unsigned char>&, std::string&)> work;
+    std::vector<unsigned char> output;
+    std::string extension;
+};
+
+static Napi::Promise QueueBufferWork(Napi::Env env, JobLane lane, Napi::Object input, bool decrypting,
+    std::function<std::string(std::vector<unsigned char>&, std::string&)> work) {
+    LockstitchBufferWorker* worker = new LockstitchBufferWorker(env, input, decrypting, work);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue(lane);
+    return promise;
+}
+
+// Decrypted range with the whole plaintext's size, for answering HTTP Range requests
+static Napi::Object RangeResult(Napi::Env env, std::vector<unsigned char>& bytes, const std::string& extension, size_t totalSize) {
+    Napi::Object result = DecryptedResult(env, bytes, extension);
+    result.Set("totalSize", Napi::Number::New(env, (double)totalSize));
+    return result;
+}
+
+// Runs a range read (decryptRange or a RangeReader's) on a scheduler lane
+class LockstitchRangeWorker : public ScheduledWorker {
+public:
+    LockstitchRangeWorker(Napi::Env env, std::function<std::string(std::vector<unsigned char>&, std::string&, size_t&)> work)
+        : ScheduledWorker(env), deferred(Napi::Promise::Deferred::New(env)), work(work), totalSize(0) {}
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    // Keeps the object the work reads through alive until the promise settles
+    void Hold(Napi::Object object) { owner = Napi::Persistent(object); }
+
+    void Execute() override {
+        try {
+            std::string error = work(output, extension, totalSize);
+            if (!error.empty())
+                SetError(error);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+        catch (...) {
+            SetError("Lockstitch operation failed");
+        }
+    }
+
+    void OnOK() override {
+        owner.Reset();
+        deferred.Resolve(RangeResult(Env(), output, extension, totalSize));
+    }
+
+    void OnError(const Napi::Error& e) override {
+        owner.Reset();
+        deferred.Reject(e.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred;
+    Napi::ObjectReference owner;
+    std::function<std::string(std::vector<unsigned char>&, std::string&, size_t&)> work;
+    std::vector<unsigned char> output;
+    std::string extension;
+    size_t totalSize;
+};
+
+// Non-negative offset and length
+static bool GetSpan(Napi::Value start, Napi::Value count, size_t& offset, size_t& length) {
+    if (!start.IsNumber() || !count.IsNumber())
+        return false;
+
+    int64_t first = start.As<Napi::Number>().Int64Value();
+    int64_t size = count.As<Napi::Number>().Int64Value();
+    if (first < 0 || size < 0)
+        return false;
+
+    offset = (size_t)first;
+    length = (size_t)size;
+    return true;
+}
+
+// (fileName, password, offset, length) with a non-negative offset and length
+static bool GetRangeArgs(const Napi::CallbackInfo& info, std::string& fileName, std::string& password, size_t& offset, size_t& length) {
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsString() || !GetSpan(info[2], info[3], offset, length))
+        return false;
+
+    fileName = info[0].As<Napi::String>().Utf8Value();
+    password = info[1].As<Napi::String>().Utf8Value();
+    return true;
+}
+
+// What inspectFile read from the end of an encrypted file
+static Napi::Object InspectResult(Napi::Env env, const ClaudoInfo& info) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("extension", Napi::String::New(env, info.extension));
+    result.Set("outputPath", Napi::String::New(env, info.outputPath));
+    result.Set("fileSize", Napi::Number::New(env, (double)info.fileSize));
+    result.Set("headSize", Napi::Number::New(env, (double)info.layout.headSize));
+    result.Set("prefixSize", Napi::Number::New(env, (double)info.layout.prefixSize));
+    result.Set("bodySize", Napi::Number::New(env, (double)info.layout.bodySize));
+    return result;
+}
+
+// Runs Lockstitch::inspectFile on the text lane; it reads a few dozen bytes whatever the file size
+class LockstitchInspectWorker : public ScheduledWorker {
+public:
+    LockstitchInspectWorker(Napi::Env env, std::string fileName, std::string password)
+        : ScheduledWorker(env), deferred(Napi::Promise::Deferred::New(env)), fileName(fileName), password(password) {}
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    void Execute() override {
+        try {
+            std::string error = Lockstitch::getLockstitch().inspectFile(fileName, password, info);
+            if (!error.empty())
+                SetError(error);
+        }
+        catch (const std::exception& e) {
+            SetError(e.what());
+        }
+        catch (...) {
+            SetError("Lockstitch operation failed");
+        }
+    }
+
+    void OnOK() override {
+        deferred.Resolve(InspectResult(Env(), info));
+    }
+
+    void OnError(const Napi::Error& e) override {
+        deferred.Reject(e.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred;
+    std::string fileName;
+    std::string password;
+    ClaudoInfo info;
+};
 
 // String Encryption
 Napi::String EncryptString(const Napi::CallbackInfo& info) {
@@ -73,12 +485,604 @@ Napi::String DecryptFile(const Napi::CallbackInfo& info) {
     return Napi::String::New(env, result);
 }
 
+// Batch String Encryption: string[] -> string[]
+Napi::Value EncryptStrings(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::vector<std::string> inputs;
+    if (info.Length() < 1 || !GetStrings(info[0], inputs)) {
+        Napi::TypeError::New(env, "Array of strings expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    return ToArray(env, lock.encryptStrings(inputs));
+}
+
+// Batch String Decryption: string[] -> string[]; invalid entries decrypt to an "Invalid input." message
+Napi::Value DecryptStrings(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::vector<std::string> inputs;
+    if (info.Length() < 1 || !GetStrings(info[0], inputs)) {
+        Napi::TypeError::New(env, "Array of strings expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    return ToArray(env, lock.decryptStrings(inputs));
+}
+
+// Buffer Encryption: (data, extension, password[, headSize]) -> Buffer
+Napi::Value EncryptBuffer(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const unsigned char* data;
+    size_t size;
+    if (info.Length() < 3 || !GetBytes(info[0], data, size) || !info[1].IsString() || !info[2].IsString()) {
+        Napi::TypeError::New(env, "Buffer, extension and password expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string extension = info[1].As<Napi::String>().Utf8Value();
+    std::string password = info[2].As<Napi::String>().Utf8Value();
+    int headSize = info.Length() > 3 && info[3].IsNumber() ? info[3].As<Napi::Number>().Int32Value() : 0;
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    std::vector<unsigned char> output;
+    std::string error = lock.encryptBuffer(data, size, output, extension, password, headSize);
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return ToBuffer(env, output);
+}
+
+// Buffer Decryption: (data, password) -> { data: Buffer, extension }
+Napi::Value DecryptBuffer(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const unsigned char* data;
+    size_t size;
+    if (info.Length() < 2 || !GetBytes(info[0], data, size) || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Buffer and password expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string password = info[1].As<Napi::String>().Utf8Value();
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    std::vector<unsigned char> output;
+    std::string extension;
+    std::string error = lock.decryptBuffer(data, size, output, extension, password);
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return DecryptedResult(env, output, extension);
+}
+
+// Async String Encryption
+Napi::Promise EncryptStringAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString())
+        return RejectedPromise(env, "String expected");
+    
+    std::string input = info[0].As<Napi::String>().Utf8Value();
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueWork(env, JobScheduler::laneFor(input.size()), [&lock, input](std::string& result) mutable {
+        result = lock.encrypt(input);
+        return true;
+    });
+}
+
+// Async String Decryption
+Napi::Promise DecryptStringAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString())
+        return RejectedPromise(env, "String expected");
+    
+    std::string input = info[0].As<Napi::String>().Utf8Value();
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueWork(env, JobScheduler::laneFor(input.size()), [&lock, input](std::string& result) mutable {
+        result = lock.decrypt(input);
+        return result.compare(0, 14, "Invalid input.") != 0;
+    });
+}
+
+// Async File Encryption
+Napi::Promise EncryptFileAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString())
+        return RejectedPromise(env, "String arguments expected");
+    
+    std::string filePath = info[0].As<Napi::String>().Utf8Value();
+    std::string password = info[1].As<Napi::String>().Utf8Value();
+    int headSize = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : 0;
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueWork(env, LANE_FILE, [&lock, filePath, password, headSize](std::string& result) {
+        result = lock.encryptFile(filePath, password, headSize);
+        return !IsFileError(result);
+    });
+}
+
+// Async File Decryption
+Napi::Promise DecryptFileAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString())
+        return RejectedPromise(env, "String arguments expected");
+    
+    std::string filePath = info[0].As<Napi::String>().Utf8Value();
+    std::string password = info[1].As<Napi::String>().Utf8Value();
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueWork(env, LANE_FILE, [&lock, filePath, password](std::string& result) {
+        result = lock.decryptFile(filePath, password);
+        return !IsFileError(result);
+    });
+}
+
+// Async Batch String Encryption
+Napi::Promise EncryptStringsAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::vector<std::string> inputs;
+    if (info.Length() < 1 || !GetStrings(info[0], inputs))
+        return RejectedPromise(env, "Array of strings expected");
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueBatchWork(env, JobScheduler::laneFor(TotalSize(inputs)), [&lock, inputs](std::vector<std::string>& results) mutable {
+        results = lock.encryptStrings(inputs);
+    });
+}
+
+// Async Batch String Decryption
+Napi::Promise DecryptStringsAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::vector<std::string> inputs;
+    if (info.Length() < 1 || !GetStrings(info[0], inputs))
+        return RejectedPromise(env, "Array of strings expected");
+    
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueBatchWork(env, JobScheduler::laneFor(TotalSize(inputs)), [&lock, inputs](std::vector<std::string>& results) mutable {
+        results = lock.decryptStrings(inputs);
+    });
+}
+
+// Async Buffer Encryption
+Napi::Promise EncryptBufferAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const unsigned char* data;
+    size_t size;
+    if (info.Length() < 3 || !GetBytes(info[0], data, size) || !info[1].IsString() || !info[2].IsString())
+        return RejectedPromise(env, "Buffer, extension and password expected");
+    
+    std::string extension = info[1].As<Napi::String>().Utf8Value();
+    std::string password = info[2].As<Napi::String>().Utf8Value();
+    int headSize = info.Length() > 3 && info[3].IsNumber() ? info[3].As<Napi::Number>().Int32Value() : 0;
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueBufferWork(env, JobScheduler::laneFor(size), info[0].As<Napi::Object>(), false,
+        [&lock, data, size, extension, password, headSize](std::vector<unsigned char>& output, std::string&) {
+            return lock.encryptBuffer(data, size, output, extension, password, headSize);
+        });
+}
+
+// Async Buffer Decryption
+Napi::Promise DecryptBufferAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const unsigned char* data;
+    size_t size;
+    if (info.Length() < 2 || !GetBytes(info[0], data, size) || !info[1].IsString())
+        return RejectedPromise(env, "Buffer and password expected");
+    
+    std::string password = info[1].As<Napi::String>().Utf8Value();
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    
+    return QueueBufferWork(env, JobScheduler::laneFor(size), info[0].As<Napi::Object>(), true,
+        [&lock, data, size, password](std::vector<unsigned char>& output, std::string& extension) {
+            return lock.decryptBuffer(data, size, output, extension, password);
+        });
+}
+
+// Range Decryption: (fileName, password, offset, length) -> { data: Buffer, extension, totalSize }.
+// Reads only the requested part of an encrypted file; the range is clipped to the plaintext's end.
+Napi::Value DecryptRange(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::string fileName, password;
+    size_t offset, length;
+    if (!GetRangeArgs(info, fileName, password, offset, length)) {
+        Napi::TypeError::New(env, "File name, password, offset and length expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::vector<unsigned char> output;
+    std::string extension;
+    size_t totalSize;
+    std::string error = Lockstitch::getLockstitch().decryptRange(fileName, password, offset, length, output, extension, totalSize);
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return RangeResult(env, output, extension, totalSize);
+}
+
+// Async Range Decryption
+Napi::Promise DecryptRangeAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::string fileName, password;
+    size_t offset, length;
+    if (!GetRangeArgs(info, fileName, password, offset, length))
+        return RejectedPromise(env, "File name, password, offset and length expected");
+    
+    LockstitchRangeWorker* worker = new LockstitchRangeWorker(env,
+        [fileName, password, offset, length](std::vector<unsigned char>& output, std::string& extension, size_t& totalSize) {
+            return Lockstitch::getLockstitch().decryptRange(fileName, password, offset, length, output, extension, totalSize);
+        });
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue(JobScheduler::laneFor(length));
+    return promise;
+}
+
+// File Inspection: (fileName, password) -> { extension, outputPath, fileSize, headSize, prefixSize, bodySize }.
+// Throws the error decryptFile would give for a wrong password or a file that is not .claudo,
+// having read only the end of the file.
+Napi::Value InspectFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "File name and password expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    ClaudoInfo result;
+    std::string error = Lockstitch::getLockstitch().inspectFile(info[0].As<Napi::String>().Utf8Value(), info[1].As<Napi::String>().Utf8Value(), result);
+    if (!error.empty()) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return InspectResult(env, result);
+}
+
+// Async File Inspection
+Napi::Promise InspectFileAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString())
+        return RejectedPromise(env, "File name and password expected");
+    
+    LockstitchInspectWorker* worker = new LockstitchInspectWorker(env, info[0].As<Napi::String>().Utf8Value(), info[1].As<Napi::String>().Utf8Value());
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue(LANE_TEXT);
+    return promise;
+}
+
+// Incremental cipher behind createEncryptStream/createDecryptStream (cipherStream.js).
+// new Cipher("encrypt", extension, password[, headSize]) or new Cipher("decrypt", password[, maxInput]).
+// update() reads each chunk in place and, like final(), returns a promise for output. Decryption only
+// buffers: nothing comes out before final(), and more than maxInput bytes of input is a RangeError.
+class Cipher : public Napi::ObjectWrap<Cipher> {
+public:
+    static Napi::Function Define(Napi::Env env) {
+        return DefineClass(env, "Cipher", {
+            InstanceMethod("update", &Cipher::Update),
+            InstanceMethod("final", &Cipher::Final),
+        });
+    }
+
+    Cipher(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Cipher>(info), finished(false) {
+        Napi::Env env = info.Env();
+        std::string mode = info.Length() > 0 && info[0].IsString() ? info[0].As<Napi::String>().Utf8Value() : "";
+        decrypting = mode == "decrypt";
+        
+        if (decrypting && info.Length() > 1 && info[1].IsString()) {
+            password = info[1].As<Napi::String>().Utf8Value();
+            if (info.Length() > 2 && info[2].IsNumber() && info[2].As<Napi::Number>().Int64Value() > 0)
+                maxInput = (size_t)info[2].As<Napi::Number>().Int64Value();
+            return;
+        }
+        if (mode == "encrypt" && info.Length() > 2 && info[1].IsString() && info[2].IsString()) {
+            int headSize = info.Length() > 3 && info[3].IsNumber() ? info[3].As<Napi::Number>().Int32Value() : 0;
+            Lockstitch::getLockstitch().beginEncrypt(state, info[1].As<Napi::String>().Utf8Value(),
+                info[2].As<Napi::String>().Utf8Value(), headSize);
+            return;
+        }
+        Napi::TypeError::New(env, "Expected (\"encrypt\", extension, password[, headSize]) or (\"decrypt\", password[, maxInput])").ThrowAsJavaScriptException();
+    }
+
+private:
+    // Returns a promise for the output of the chunk. Encryption runs on the file lane whatever the chunk
+    // size, since the chunks of one stream add up to a file; the one that completes the prefix also pays
+    // for its multiply. The caller must wait before the next update().
+    Napi::Value Update(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        
+        const unsigned char* data;
+        size_t size;
+        if (info.Length() < 1 || !GetBytes(info[0], data, size))
+            return RejectedPromise(env, "Buffer expected");
+        if (finished) {
+            Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+            deferred.Reject(Napi::Error::New(env, "Cipher already finished").Value());
+            return deferred.Promise();
+        }
+        if (busy)
+            return Busy(env);
+        
+        // The key position is stored at the end, so decryption can only collect until final(),
+        // and only up to maxInput bytes
+        if (decrypting) {
+            Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+            if (maxInput && size > maxInput - input.size()) {
+                finished = true;
+                input = std::vector<unsigned char>();
+                deferred.Reject(Napi::RangeError::New(env, "Encrypted input is larger than " + std::to_string(maxInput) + " bytes").Value());
+                return deferred.Promise();
+            }
+            input.insert(input.end(), data, data + size);
+            deferred.Resolve(Napi::Buffer<unsigned char>::New(env, 0));
+            return deferred.Promise();
+        }
+        
+        Lockstitch& lock = Lockstitch::getLockstitch();
+        return Queue(info, LANE_FILE, info[0].As<Napi::Object>(), false,
+            [this, &lock, data, size](std::vector<unsigned char>& output, std::string&) {
+                lock.encryptUpdate(state, data, size, output);
+                return std::string();
+            });
+    }
+
+    Napi::Value Final(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        
+        if (finished)
+            return RejectedPromise(env, "Cipher already finished");
+        if (busy)
+            return Busy(env);
+        finished = true;
+        
+        Lockstitch& lock = Lockstitch::getLockstitch();
+        if (decrypting)
+            return Queue(info, JobScheduler::laneFor(input.size()), info.This().As<Napi::Object>(), true,
+                [this, &lock](std::vector<unsigned char>& output, std::string& extension) {
+                    std::string error = lock.decryptBuffer(input.data(), input.size(), output, extension, password);
+                    input = std::vector<unsigned char>();
+                    return error;
+                });
+        
+        return Queue(info, LANE_FILE, info.This().As<Napi::Object>(), false,
+            [this, &lock](std::vector<unsigned char>& output, std::string&) {
+                lock.encryptFinal(state, output);
+                return std::string();
+            });
+    }
+
+    static Napi::Promise Busy(Napi::Env env) {
+        Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+        deferred.Reject(Napi::Error::New(env, "Cipher is busy; wait for the previous update() or final() to settle").Value());
+        return deferred.Promise();
+    }
+
+    // QueueBufferWork that also keeps this Cipher alive while a worker uses its state, and marks it
+    // busy until the promise settles, so no two calls touch the state at once
+    Napi::Promise Queue(const Napi::CallbackInfo& info, JobLane lane, Napi::Object input, bool decrypting,
+        std::function<std::string(std::vector<unsigned char>&, std::string&)> work) {
+        LockstitchBufferWorker* worker = new LockstitchBufferWorker(info.Env(), input, decrypting, work);
+        busy = true;
+        worker->Hold(info.This().As<Napi::Object>(), [this] { busy = false; });
+        Napi::Promise promise = worker->GetPromise();
+        worker->Queue(lane);
+        return promise;
+    }
+
+    bool decrypting;
+    bool finished;
+    // An update() or final() is running on a scheduler lane
+    bool busy = false;
+    // Bytes decryption collects before update() rejects; 0 for no limit
+    size_t maxInput = 0;
+    EncryptState state;
+    std::string password;
+    std::vector<unsigned char> input;
+};
+
+// An encrypted file opened for a series of range reads, such as one media response sent a chunk at a time:
+// new RangeReader(fileName, password), then read(offset, length) -> Promise<{ data, extension, totalSize }>.
+// The first read checks the file and divides its prefix; the rest reuse that and cost only their own bytes.
+class RangeReader : public Napi::ObjectWrap<RangeReader> {
+public:
+    static Napi::Function Define(Napi::Env env) {
+        return DefineClass(env, "RangeReader", {
+            InstanceMethod("read", &RangeReader::Read),
+        });
+    }
+
+    RangeReader(const Napi::CallbackInfo& info) : Napi::ObjectWrap<RangeReader>(info) {
+        if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+            Napi::TypeError::New(info.Env(), "File name and password expected").ThrowAsJavaScriptException();
+            return;
+        }
+        fileName = info[0].As<Napi::String>().Utf8Value();
+        password = info[1].As<Napi::String>().Utf8Value();
+    }
+
+private:
+    // Reads may overlap; whichever runs first opens the file and the others wait for it
+    Napi::Value Read(const Napi::CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        
+        size_t offset, length;
+        if (info.Length() < 2 || !GetSpan(info[0], info[1], offset, length))
+            return RejectedPromise(env, "Offset and length expected");
+        
+        LockstitchRangeWorker* worker = new LockstitchRangeWorker(env,
+            [this, offset, length](std::vector<unsigned char>& output, std::string& extension, size_t& totalSize) {
+                Lockstitch& lock = Lockstitch::getLockstitch();
+                std::call_once(opened, [this, &lock] { openError = lock.openRange(fileName, password, range); });
+                if (!openError.empty())
+                    return openError;
+                extension = range.info.extension;
+                totalSize = range.totalSize;
+                return lock.readRange(range, offset, length, output);
+            });
+        worker->Hold(info.This().As<Napi::Object>());
+        Napi::Promise promise = worker->GetPromise();
+        worker->Queue(JobScheduler::laneFor(length));
+        return promise;
+    }
+
+    std::string fileName;
+    std::string password;
+    std::once_flag opened;
+    std::string openError;
+    ClaudoRange range;
+};
+
+// Threads of each lane's helper pool, for text batches and large XOR passes
+Napi::Number SetThreadCount(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return Napi::Number::New(env, 0);
+    }
+    
+    int64_t threads = info[0].As<Napi::Number>().Int64Value();
+    Lockstitch& lock = Lockstitch::getLockstitch();
+    size_t result = lock.setThreadCount(threads > 0 ? (size_t)threads : 0);
+    
+    return Napi::Number::New(env, (double)result);
+}
+
+// Threads of one scheduler lane: ("text" | "file", count), 0 for the default; returns the count in effect
+Napi::Value SetSchedulerThreads(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::string lane = info.Length() > 0 && info[0].IsString() ? info[0].As<Napi::String>().Utf8Value() : "";
+    if ((lane != "text" && lane != "file") || info.Length() < 2 || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Lane (\"text\" or \"file\") and thread count expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int64_t threads = info[1].As<Napi::Number>().Int64Value();
+    size_t result = JobScheduler::shared().setThreadCount(lane == "text" ? LANE_TEXT : LANE_FILE, threads > 0 ? (size_t)threads : 0);
+    
+    return Napi::Number::New(env, (double)result);
+}
+
+// Native log level: "off", "error", "warn", "info" or "debug"; returns the level now in effect
+Napi::Value SetLogLevel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    static const char* const names[] = { "off", "error", "warn", "info", "debug" };
+
+    if (info.Length() >= 1) {
+        int level = info[0].IsString() ? Log::parseLevel(info[0].As<Napi::String>().Utf8Value()) : -1;
+        if (level < 0) {
+            Napi::TypeError::New(env, "Log level must be one of off, error, warn, info, debug").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Log::setLevel(level);
+    }
+
+    return Napi::String::New(env, names[Log::level()]);
+}
+
+// Per-phase counters and timings since load (or the last reset), plus the scheduler lanes right now:
+// { phases: { load: { calls, bytes, totalNs, maxNs, p50Ns, p99Ns }, muldiv, hex, xor, write, textWait, fileWait },
+//   scheduler: { text: { threads, queued, running, completed }, file } }.
+// Passing true resets the phase counters after reading them.
+Napi::Value GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    std::vector<PhaseStats> stats = Stats::snapshot();
+    ArenaStats arena = Arena::stats();
+    if (info.Length() >= 1 && info[0].ToBoolean().Value()) {
+        Stats::reset();
+        Arena::resetStats();
+    }
+
+    Napi::Object phases = Napi::Object::New(env);
+    for (const PhaseStats& s : stats) {
+        Napi::Object phase = Napi::Object::New(env);
+        phase.Set("calls", Napi::Number::New(env, (double)s.calls));
+        phase.Set("bytes", Napi::Number::New(env, (double)s.bytes));
+        phase.Set("totalNs", Napi::Number::New(env, (double)s.totalNs));
+        phase.Set("maxNs", Napi::Number::New(env, (double)s.maxNs));
+        phase.Set("p50Ns", Napi::Number::New(env, (double)s.p50Ns));
+        phase.Set("p99Ns", Napi::Number::New(env, (double)s.p99Ns));
+        phases.Set(s.name, phase);
+    }
+
+    Napi::Object scheduler = Napi::Object::New(env);
+    for (const LaneStats& s : JobScheduler::shared().snapshot()) {
+        Napi::Object lane = Napi::Object::New(env);
+        lane.Set("threads", Napi::Number::New(env, (double)s.threads));
+        lane.Set("queued", Napi::Number::New(env, (double)s.queued));
+        lane.Set("running", Napi::Number::New(env, (double)s.running));
+        lane.Set("completed", Napi::Number::New(env, (double)s.completed));
+        scheduler.Set(s.name, lane);
+    }
+
+    Napi::Object allocations = Napi::Object::New(env);
+    allocations.Set("allocs", Napi::Number::New(env, (double)arena.allocs));
+    allocations.Set("bytes", Napi::Number::New(env, (double)arena.bytes));
+    allocations.Set("blocks", Napi::Number::New(env, (double)arena.blocks));
+    allocations.Set("blockBytes", Napi::Number::New(env, (double)arena.blockBytes));
+    allocations.Set("hugeBlocks", Napi::Number::New(env, (double)arena.hugeBlocks));
+    allocations.Set("retainedBytes", Napi::Number::New(env, (double)arena.retainedBytes));
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("phases", phases);
+    result.Set("scheduler", scheduler);
+    result.Set("allocations", allocations);
+    return result;
+}
+
 // Initialize the addon
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
     exports.Set("encryptString", Napi::Function::New(env, EncryptString));
     exports.Set("decryptString", Napi::Function::New(env, DecryptString));
     exports.Set("encryptFile", Napi::Function::New(env, EncryptFile));
     exports.Set("decryptFile", Napi::Function::New(env, DecryptFile));
+    exports.Set("encryptStringAsync", Napi::Function::New(env, EncryptStringAsync));
+    exports.Set("decryptStringAsync", Napi::Function::New(env, DecryptStringAsync));
+    exports.Set("encryptFileAsync", Napi::Function::New(env, EncryptFileAsync));
+    exports.Set("decryptFileAsync", Napi::Function::New(env, DecryptFileAsync));
+    exports.Set("encryptStrings", Napi::Function::New(env, EncryptStrings));
+    exports.Set("decryptStrings", Napi::Function::New(env, DecryptStrings));
+    exports.Set("encryptStringsAsync", Napi::Function::New(env, EncryptStringsAsync));
+    exports.Set("decryptStringsAsync", Napi::Function::New(env, DecryptStringsAsync));
+    exports.Set("encryptBuffer", Napi::Function::New(env, EncryptBuffer));
+    exports.Set("decryptBuffer", Napi::Function::New(env, DecryptBuffer));
+    exports.Set("encryptBufferAsync", Napi::Function::New(env, EncryptBufferAsync));
+    exports.Set("decryptBufferAsync", Napi::Function::New(env, DecryptBufferAsync));
+    exports.Set("decryptRange", Napi::Function::New(env, DecryptRange));
+    exports.Set("decryptRangeAsync", Napi::Function::New(env, DecryptRangeAsync));
+    exports.Set("inspectFile", Napi::Function::New(env, InspectFile));
+    exports.Set("inspectFileAsync", Napi::Function::New(env, InspectFileAsync));
+    exports.Set("Cipher", Cipher::Define(env));
+    exports.Set("RangeReader", RangeReader::Define(env));
+    exports.Set("setThreadCount", Napi::Function::New(env, SetThreadCount));
+    exports.Set("setSchedulerThreads", Napi::Function::New(env, SetSchedulerThreads));
+    exports.Set("setLogLevel", Napi::Function::New(env, SetLogLevel));
+    exports.Set("stats", Napi::Function::New(env, GetStats));
     return exports;
 }
 
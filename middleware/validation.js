@@ -17,6 +17,34 @@ const validateTextInput = (req, res, next) => {
   next();
 };
 
+const validateTextBatchInput = (req, res, next) => {
+  const { texts, encryptedTexts } = req.body;
+  const textsToValidate = texts || encryptedTexts;
+
+  if (!Array.isArray(textsToValidate) || textsToValidate.some((t) => typeof t !== 'string')) {
+    return res.status(400).json({ error: 'Invalid text batch input' });
+  }
+
+  if (textsToValidate.length > 100000) {
+    return res.status(400).json({ error: 'Too many texts. Maximum 100000 per batch.' });
+  }
+
+  // Same per-text limit as validateTextInput, plus a cap on the whole batch
+  let total = 0;
+  for (const t of textsToValidate) {
+    if (t.length > 1000000) { // 1MB limit
+      return res.status(400).json({ error: 'Text too large. Maximum 1MB.' });
+    }
+    total += t.length;
+  }
+
+  if (total > 10000000) { // 10MB limit
+    return res.status(400).json({ error: 'Batch too large. Maximum 10MB in total.' });
+  }
+
+  next();
+};
+
 const validateFileInput = (req, res, next) => {
   const { password } = req.body;
 
@@ -55,6 +83,7 @@ const validateLoginInput = (req, res, next) => {
 
 module.exports = {
   validateTextInput,
+  validateTextBatchInput,
   validateFileInput,
   validateLoginInput
 };
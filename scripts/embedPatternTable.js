@@ -0,0 +1,46 @@
+// Embeds the pattern table (cpp/code.txt) in a C++ header as a constexpr array.
+//
+// usage: node scripts/embedPatternTable.js <code.txt> <PatternTable.h>
+//
+// Run by binding.gyp and bench/CMakeLists.txt before compiling; the table stops at its first NUL
+// byte, as it did when it was read from Code.txt at runtime.
+const fs = require('fs');
+const path = require('path');
+
+const [input, output] = process.argv.slice(2);
+if (!input || !output) {
+  console.error('usage: node embedPatternTable.js <code.txt> <PatternTable.h>');
+  process.exit(1);
+}
+
+let table = fs.readFileSync(input);
+const nul = table.indexOf(0);
+if (nul >= 0) {
+  table = table.subarray(0, nul);
+}
+if (table.length < 12) {
+  console.error(`${input}: pattern table must hold at least 12 bytes`);
+  process.exit(1);
+}
+
+const rows = [];
+for (let i = 0; i < table.length; i += 16) {
+  rows.push('\t' + Array.from(table.subarray(i, i + 16), (b) => `0x${b.toString(16).padStart(2, '0')},`).join(' '));
+}
+
+const header = `// Generated by scripts/embedPatternTable.js from ${path.basename(input)}; do not edit
+#pragma once
+#include <cstddef>
+
+constexpr char PATTERN_TABLE[] = {
+${rows.join('\n')}
+\t0x00
+};
+constexpr size_t PATTERN_TABLE_SIZE = ${table.length};
+`;
+
+fs.mkdirSync(path.dirname(output), { recursive: true });
+// Leave an unchanged header alone so its dependents are not rebuilt
+if (!fs.existsSync(output) || fs.readFileSync(output, 'utf8') !== header) {
+  fs.writeFileSync(output, header);
+}